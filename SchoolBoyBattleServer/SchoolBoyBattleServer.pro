@@ -1,4 +1,4 @@
-QT       += core gui network
+QT       += core gui network xml
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -8,17 +8,61 @@ CONFIG += c++11
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Protocole partagé entre le client et le serveur
+INCLUDEPATH += ../common
+
 SOURCES += \
+    ../common/framereader.cpp \
+    ../common/protocol.cpp \
+    bot.cpp \
+    candyregistry.cpp \
+    gamemap.cpp \
+    headlessserver.cpp \
+    logger.cpp \
     main.cpp \
     mainwindow.cpp \
+    matchmaker.cpp \
+    matchrecorder.cpp \
+    metrics.cpp \
+    metricsserver.cpp \
+    recordwriter.cpp \
+    room.cpp \
+    serverconfig.cpp \
     serverworker.cpp \
+    shardreporter.cpp \
+    shardrouter.cpp \
+    simulation.cpp \
+    snapshotencoder.cpp \
     tcpserver.cpp
 
 HEADERS += \
+    ../common/framereader.h \
+    ../common/messagedispatcher.h \
+    ../common/protocol.h \
+    bot.h \
+    candyregistry.h \
+    gamemap.h \
+    headlessserver.h \
+    logger.h \
     mainwindow.h \
+    matchmaker.h \
+    matchrecorder.h \
+    metrics.h \
+    metricsserver.h \
+    recordwriter.h \
+    room.h \
+    serverconfig.h \
     serverworker.h \
+    shardreporter.h \
+    shardrouter.h \
+    simulation.h \
+    snapshotencoder.h \
     tcpserver.h
 
+# Terrain du client, lu par le serveur pour les règles du jeu
+RESOURCES += \
+    maps.qrc
+
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
@@ -0,0 +1,144 @@
+/*
+ * Description : Cette classe représente un joueur contrôlé par le serveur.
+ *               Un bot n'a ni socket, ni messages, ni timer : la partie
+ *               l'appelle avant chaque pas de sa Simulation, et il donne à
+ *               la simulation les mêmes touches qu'un client humain. Il ne
+ *               choisit sa cible que quelques fois par seconde et se
+ *               contente de s'en approcher entre deux décisions, ce qui
+ *               permet d'en faire tourner beaucoup par thread.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "bot.h"
+#include <cstdlib>
+
+#define BOT_DECISION_TICKS 6        // 5 décisions par seconde, décalées d'un bot à l'autre
+#define BOT_CARRY_LIMIT 3           // Au-delà, le bot rentre valider ses candies
+#define BOT_DEAD_ZONE 20            // Pixels, évite d'osciller autour de la cible
+#define BOT_STUCK_TICKS 8           // Bloqué contre un mur depuis un quart de seconde
+#define BOT_DETOUR_TICKS 20
+
+Bot::Bot(qintptr descriptor, const QString &username) :
+    descriptor(descriptor),
+    username(username),
+    team(0),
+    gender(0)
+{
+    reset();
+}
+
+qintptr Bot::getDescriptor() const {
+    return descriptor;
+}
+
+QString Bot::getUsername() const {
+    return username;
+}
+
+int Bot::getTeam() const {
+    return team;
+}
+
+int Bot::getGender() const {
+    return gender;
+}
+
+void Bot::setTeam(int team) {
+    this->team = team;
+}
+
+void Bot::setGender(int gender) {
+    this->gender = gender;
+}
+
+/*
+ * Nouvelle partie : aucune touche enfoncée dans la simulation
+ */
+void Bot::reset()
+{
+    moves = 0;
+    target = QPointF();
+    lastFeet = QPointF();
+    stuckTicks = 0;
+    detourTicks = 0;
+    detourMoves = 0;
+}
+
+/*
+ * Appelé par la partie avant chaque pas de la simulation
+ */
+void Bot::step(Simulation *simulation)
+{
+    QPointF feet;
+    if(!simulation->getPlayerFeet(descriptor, &feet))
+        return;
+
+    // Des touches enfoncées mais aucun mouvement : un mur est dans le chemin
+    if(moves != 0 && (feet - lastFeet).manhattanLength() < 1)
+        stuckTicks++;
+    else
+        stuckTicks = 0;
+    lastFeet = feet;
+    if(stuckTicks >= BOT_STUCK_TICKS) {
+        stuckTicks = 0;
+        detourTicks = BOT_DETOUR_TICKS;
+        detourMoves = 1 << (rand() % 4);
+    }
+    if(detourTicks > 0) {
+        detourTicks--;
+        press(simulation, detourMoves);
+        return;
+    }
+
+    if((simulation->getTick() + quint32(-descriptor)) % BOT_DECISION_TICKS == 0 || target.isNull())
+        decide(simulation, feet);
+
+    int newMoves = 0;
+    const QPointF delta = target - feet;
+    if(delta.x() > BOT_DEAD_ZONE)
+        newMoves |= 1 << Simulation::Right;
+    else if(delta.x() < -BOT_DEAD_ZONE)
+        newMoves |= 1 << Simulation::Left;
+    if(delta.y() > BOT_DEAD_ZONE)
+        newMoves |= 1 << Simulation::Down;
+    else if(delta.y() < -BOT_DEAD_ZONE)
+        newMoves |= 1 << Simulation::Up;
+    press(simulation, newMoves);
+}
+
+/*
+ * Rentre valider avec assez de candies, sinon va vers le candy le plus
+ * proche (libre ou porté par un adversaire). Sans candy sur le terrain, le
+ * bot valide ce qu'il porte ou va chercher les adversaires chez eux.
+ */
+void Bot::decide(const Simulation *simulation, const QPointF &feet)
+{
+    const int nbCarried = simulation->getNbCarried(descriptor);
+    QPointF candy;
+    if(nbCarried >= BOT_CARRY_LIMIT)
+        target = simulation->getBaseFeet(team);
+    else if(simulation->nearestCandy(descriptor, feet, &candy))
+        target = candy;
+    else if(nbCarried > 0)
+        target = simulation->getBaseFeet(team);
+    else
+        target = simulation->getBaseFeet(!team);
+}
+
+/*
+ * Seules les touches qui changent sont données à la simulation, comme les
+ * messages playerMove d'un client
+ */
+void Bot::press(Simulation *simulation, int newMoves)
+{
+    const int changed = moves ^ newMoves;
+    if(changed == 0)
+        return;
+    for(int direction = Simulation::Up; direction <= Simulation::Left; direction++) {
+        if(changed & (1 << direction))
+            simulation->setInput(descriptor, direction, newMoves & (1 << direction));
+    }
+    moves = newMoves;
+}
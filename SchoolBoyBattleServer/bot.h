@@ -0,0 +1,53 @@
+/*
+ * Description : Cette classe représente un joueur contrôlé par le serveur.
+ *               Un bot n'a ni socket, ni messages, ni timer : la partie
+ *               l'appelle avant chaque pas de sa Simulation, et il donne à
+ *               la simulation les mêmes touches qu'un client humain. Il ne
+ *               choisit sa cible que quelques fois par seconde et se
+ *               contente de s'en approcher entre deux décisions, ce qui
+ *               permet d'en faire tourner beaucoup par thread.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef BOT_H
+#define BOT_H
+
+#include "simulation.h"
+
+#include <QPointF>
+#include <QString>
+
+class Bot
+{
+public:
+    Bot(qintptr descriptor = 0, const QString &username = QString());
+
+    qintptr getDescriptor() const;
+    QString getUsername() const;
+    int getTeam() const;
+    int getGender() const;
+    void setTeam(int team);
+    void setGender(int gender);
+
+    void reset();
+    void step(Simulation *simulation);
+
+private:
+    qintptr descriptor;
+    QString username;
+    int team;
+    int gender;
+    int moves;                  // Touches enfoncées, un bit par Simulation::Direction
+    QPointF target;             // Centre des pieds visé
+    QPointF lastFeet;
+    int stuckTicks;             // Pas passés sans avancer malgré les touches
+    int detourTicks;            // Pas restants à contourner un mur
+    int detourMoves;
+
+    void decide(const Simulation *simulation, const QPointF &feet);
+    void press(Simulation *simulation, int newMoves);
+};
+
+#endif // BOT_H
@@ -0,0 +1,197 @@
+/*
+ * Description : Cette classe garde l'état de tous les candies d'une partie,
+ *               dans un tableau indexé par l'id du candy : libre, dans la
+ *               file d'un joueur ou validé. C'est le serveur qui décide qui
+ *               récupère, vole ou valide un candy. Chaque changement de
+ *               propriétaire donne une nouvelle génération au candy : une
+ *               demande faite avec une ancienne génération est refusée.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "candyregistry.h"
+
+// Un id plus grand est refusé, le tableau ne grandit pas sans limite
+#define MAX_CANDY_ID 65536
+// Mêmes valeurs que chez le client
+#define CANDY_MAX 50
+#define QUEUE_PROTECTED_TIME_MS 750
+
+CandyRegistry::CandyRegistry() :
+    nextGeneration(0)
+{
+}
+
+/*
+ * Nouvelle partie, plus aucun candy. La mémoire du tableau est gardée.
+ */
+void CandyRegistry::clear()
+{
+    entries.clear();
+    queues.clear();
+    nextGeneration = 0;
+}
+
+bool CandyRegistry::isValidId(int candyId) const
+{
+    return candyId >= 0 && candyId < entries.size();
+}
+
+CandyRegistry::Queue &CandyRegistry::queueOf(qintptr player)
+{
+    QHash<qintptr, Queue>::iterator queue = queues.find(player);
+    if(queue == queues.end())
+        queue = queues.insert(player, Queue{-1, -1, 0, 0});
+    return queue.value();
+}
+
+/*
+ * Un candy apparait, libre et avec la génération 0
+ */
+bool CandyRegistry::spawn(int candyId, int nbPoints)
+{
+    if(candyId < 0 || candyId >= MAX_CANDY_ID)
+        return false;
+    if(candyId >= entries.size())
+        entries.resize(candyId + 1);    // Les nouvelles entrées sont à zéro, donc Unused
+    Entry &entry = entries[candyId];
+    if(entry.state != Unused)
+        return false;
+    entry = Entry{Free, -1, 0, nbPoints, -1, -1};
+    return true;
+}
+
+/*
+ * Un joueur ramasse un candy libre, il est ajouté au début de sa file
+ */
+bool CandyRegistry::claim(int candyId, quint32 generation, qintptr player, quint32 *newGeneration)
+{
+    if(!isValidId(candyId))
+        return false;
+    Entry &entry = entries[candyId];
+    if(entry.state != Free || entry.generation != generation)
+        return false;
+    Queue &queue = queueOf(player);
+    if(queue.count >= CANDY_MAX)
+        return false;
+
+    entry.state = Held;
+    entry.owner = player;
+    entry.generation = ++nextGeneration;
+    entry.newer = -1;
+    entry.older = queue.head;
+    if(queue.head != -1)
+        entries[queue.head].newer = candyId;
+    else
+        queue.tail = candyId;
+    queue.head = candyId;
+    queue.count++;
+
+    *newGeneration = entry.generation;
+    return true;
+}
+
+/*
+ * Un joueur vole un candy et tous ceux qui le suivent dans la file de
+ * l'adversaire. Retourne le nombre de candies volés, 0 si le vol est refusé.
+ * Les équipes sont vérifiées par la partie.
+ */
+int CandyRegistry::steal(int candyId, quint32 generation, qintptr player, qint64 nowMs, quint32 *newGeneration)
+{
+    if(!isValidId(candyId))
+        return 0;
+    Entry &first = entries[candyId];
+    if(first.state != Held || first.owner == player || first.generation != generation)
+        return 0;
+    // Le voleur d'abord : son insertion dans le hash invaliderait la référence sur la victime
+    Queue &stealer = queueOf(player);
+    if(stealer.count >= CANDY_MAX)
+        return 0;
+    Queue &victim = queueOf(first.owner);
+    if(victim.protectedUntilMs > nowMs)
+        return 0;
+
+    // On coupe la file de l'adversaire juste avant le candy volé
+    const int last = victim.tail;
+    victim.tail = first.newer;
+    if(first.newer != -1)
+        entries[first.newer].older = -1;
+    else
+        victim.head = -1;
+
+    // Les candies volés changent de propriétaire et de génération
+    const quint32 stolenGeneration = ++nextGeneration;
+    int nbStolen = 0;
+    for(int i = candyId; i != -1; i = entries[i].older) {
+        entries[i].owner = player;
+        entries[i].generation = stolenGeneration;
+        nbStolen++;
+    }
+    victim.count -= nbStolen;
+
+    // Et passent devant la file du voleur, qui est protégée un moment
+    first.newer = -1;
+    entries[last].older = stealer.head;
+    if(stealer.head != -1)
+        entries[stealer.head].newer = last;
+    else
+        stealer.tail = last;
+    stealer.head = candyId;
+    stealer.count += nbStolen;
+    stealer.protectedUntilMs = nowMs + QUEUE_PROTECTED_TIME_MS;
+
+    *newGeneration = stolenGeneration;
+    return nbStolen;
+}
+
+/*
+ * Le joueur valide tous les candies de sa file, retourne le nombre de points
+ */
+int CandyRegistry::validate(qintptr player, int *nbCandies)
+{
+    Queue &queue = queueOf(player);
+    int nbPoints = 0;
+    for(int i = queue.head; i != -1; i = entries[i].older) {
+        entries[i].state = Validated;
+        entries[i].generation = ++nextGeneration;
+        nbPoints += entries[i].nbPoints;
+    }
+    if(nbCandies != nullptr)
+        *nbCandies = queue.count;
+    queue.head = -1;
+    queue.tail = -1;
+    queue.count = 0;
+    return nbPoints;
+}
+
+int CandyRegistry::size() const
+{
+    return entries.size();
+}
+
+CandyRegistry::State CandyRegistry::getState(int candyId) const
+{
+    return isValidId(candyId) ? entries.at(candyId).state : Unused;
+}
+
+qintptr CandyRegistry::getOwner(int candyId) const
+{
+    return isValidId(candyId) ? entries.at(candyId).owner : -1;
+}
+
+quint32 CandyRegistry::getGeneration(int candyId) const
+{
+    return isValidId(candyId) ? entries.at(candyId).generation : 0;
+}
+
+int CandyRegistry::getNewest(qintptr player) const
+{
+    QHash<qintptr, Queue>::const_iterator queue = queues.constFind(player);
+    return queue != queues.constEnd() ? queue.value().head : -1;
+}
+
+int CandyRegistry::getOlder(int candyId) const
+{
+    return isValidId(candyId) ? entries.at(candyId).older : -1;
+}
@@ -0,0 +1,66 @@
+/*
+ * Description : Cette classe garde l'état de tous les candies d'une partie,
+ *               dans un tableau indexé par l'id du candy : libre, dans la
+ *               file d'un joueur ou validé. C'est le serveur qui décide qui
+ *               récupère, vole ou valide un candy. Chaque changement de
+ *               propriétaire donne une nouvelle génération au candy : une
+ *               demande faite avec une ancienne génération est refusée.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef CANDYREGISTRY_H
+#define CANDYREGISTRY_H
+
+#include <QHash>
+#include <QVector>
+
+class CandyRegistry
+{
+public:
+    enum State : quint8 {Unused = 0, Free, Held, Validated};
+
+    CandyRegistry();
+    void clear();
+
+    bool spawn(int candyId, int nbPoints);
+    bool claim(int candyId, quint32 generation, qintptr player, quint32 *newGeneration);
+    int steal(int candyId, quint32 generation, qintptr player, qint64 nowMs, quint32 *newGeneration);
+    int validate(qintptr player, int *nbCandies = nullptr);
+
+    int size() const;
+    State getState(int candyId) const;
+    qintptr getOwner(int candyId) const;
+    quint32 getGeneration(int candyId) const;
+    // Parcours de la file d'un joueur, du plus récent au plus ancien
+    int getNewest(qintptr player) const;
+    int getOlder(int candyId) const;
+
+private:
+    typedef struct Entry_s {
+        State state;
+        qintptr owner;
+        quint32 generation;
+        int nbPoints;
+        int newer;      // Candy suivant vers le joueur dans sa file, -1 si aucun
+        int older;      // Candy suivant vers la fin de la file, -1 si aucun
+    } Entry;
+
+    // File de candies derrière un joueur, du plus récent au plus ancien
+    typedef struct Queue_s {
+        int head;
+        int tail;
+        int count;
+        qint64 protectedUntilMs;
+    } Queue;
+
+    QVector<Entry> entries;
+    QHash<qintptr, Queue> queues;
+    quint32 nextGeneration;
+
+    bool isValidId(int candyId) const;
+    Queue &queueOf(qintptr player);
+};
+
+#endif // CANDYREGISTRY_H
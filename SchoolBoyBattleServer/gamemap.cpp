@@ -0,0 +1,215 @@
+/*
+ * Description : Cette classe lit le terrain (.tmx) côté serveur et n'en
+ *               garde que ce qui sert aux règles du jeu : les murs, les
+ *               bases des équipes, les points d'apparition des joueurs et
+ *               les emplacements des candies. Elle est chargée une seule
+ *               fois et partagée, en lecture seule, par toutes les parties.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "gamemap.h"
+#include "logger.h"
+#include <QDomDocument>
+#include <QFile>
+#include <QStringList>
+#include <QtMath>
+
+// Mêmes valeurs que le DataLoader du client
+#define TILE_SIZE 130
+#define COLLISION_LAYER "4-collision"
+#define SPAWNS_LAYER "1-spawns"
+#define CONFIG_LAYER "5-config"
+#define CANDY_PLACEMENTS_LAYER "6-candy-placements"
+
+GameMap::GameMap() :
+    loaded(false),
+    collisions{0, 0, 0, 0, QVector<int>()},
+    spawns{0, 0, 0, 0, QVector<int>()},
+    teamSpawnTileTypes{-1, -1}
+{
+}
+
+/*
+ * Lit le terrain, retourne false si le fichier n'a pas pu être lu
+ */
+bool GameMap::load(const QString &fileName)
+{
+    QFile file(fileName);
+    QDomDocument document;
+    if(!file.open(QIODevice::ReadOnly) || !document.setContent(&file)) {
+        Logger::log(Logger::Error, "Impossible de lire le terrain " + fileName);
+        return false;
+    }
+    file.close();
+
+    const QHash<int, QString> tileNames = readTileNames(document);
+    QHash<QString, Layer> layers;
+    const QDomNodeList layerNodes = document.elementsByTagName("layer");
+    for(int i = 0; i < layerNodes.count(); i++) {
+        const QDomElement layer = layerNodes.at(i).toElement();
+        layers.insert(layer.attribute("name"), readLayer(layer));
+    }
+
+    collisions = layers.value(COLLISION_LAYER);
+    spawns = layers.value(SPAWNS_LAYER);
+    teamSpawnTileTypes[0] = tileNames.key("world/config/spawn-red.png", -1);
+    teamSpawnTileTypes[1] = tileNames.key("world/config/spawn-black.png", -1);
+
+    // Points d'apparition des joueurs
+    const Layer config = layers.value(CONFIG_LAYER);
+    for(int y = 0; y < config.height; y++) {
+        for(int x = 0; x < config.width; x++) {
+            const QString name = tileNames.value(config.tiles.at(y * config.width + x));
+            const QPointF pos(TILE_SIZE * (x + config.topLeftX), TILE_SIZE * (y + config.topLeftY));
+            if(name == "world/config/spawn-player-red.png")
+                teamSpawnpoints[0] = pos;
+            else if(name == "world/config/spawn-player-black.png")
+                teamSpawnpoints[1] = pos;
+        }
+    }
+
+    // Emplacements des candies, ligne par ligne comme Game::placeTilesCandyPlacement
+    const Layer placements = layers.value(CANDY_PLACEMENTS_LAYER);
+    candyPlacements.clear();
+    for(int y = 0; y < placements.height; y++) {
+        for(int x = 0; x < placements.width; x++) {
+            const int tileType = placements.tiles.at(y * placements.width + x);
+            if(tileType == 0)
+                continue;
+            // L'index doit rester aligné avec le client, même pour un tile inconnu
+            const QString name = tileNames.value(tileType);
+            const QPointF pos(TILE_SIZE * (x + placements.topLeftX), TILE_SIZE * (y + placements.topLeftY));
+            if(name == "candy/peanut-small.png")
+                candyPlacements.append(CandyPlacement{pos, 0, 0, 1, 25 * 1000});
+            else if(name == "candy/mandarin-small.png")
+                candyPlacements.append(CandyPlacement{pos, 1, 0, 3, 30 * 1000});
+            else if(name == "candy/peanut-big.png")
+                candyPlacements.append(CandyPlacement{pos, 0, 1, 5, 20 * 1000});
+            else if(name == "candy/mandarin-big.png")
+                candyPlacements.append(CandyPlacement{pos, 1, 1, 10, 30 * 1000});
+            else
+                candyPlacements.append(CandyPlacement{pos, -1, 0, 0, 0});
+        }
+    }
+
+    loaded = true;
+    Logger::log(Logger::Info, "Terrain " + fileName + " chargé, " + QString::number(candyPlacements.size()) + " emplacements de candies");
+    return true;
+}
+
+bool GameMap::isLoaded() const
+{
+    return loaded;
+}
+
+/*
+ * Les noms des images des tiles, par type de tile (firstgid + id)
+ */
+QHash<int, QString> GameMap::readTileNames(const QDomDocument &document)
+{
+    QHash<int, QString> tileNames;
+    const QDomNodeList tilesets = document.elementsByTagName("tileset");
+    for(int i = 0; i < tilesets.count(); i++) {
+        const QDomElement tileset = tilesets.at(i).toElement();
+        const int firstId = tileset.attribute("firstgid").toInt();
+        const QDomNodeList tiles = tileset.childNodes();
+        for(int j = 0; j < tiles.count(); j++) {
+            const QDomElement tile = tiles.at(j).toElement();
+            if(tile.tagName() == "tile")
+                tileNames.insert(firstId + tile.attribute("id").toInt(), tile.firstChildElement("image").attribute("source"));
+        }
+    }
+    return tileNames;
+}
+
+/*
+ * Une couche d'un terrain infini est découpée en chunks carrés, on les
+ * rassemble dans un seul tableau qui commence au chunk le plus en haut à gauche
+ */
+GameMap::Layer GameMap::readLayer(const QDomElement &layer)
+{
+    Layer result{0, 0, 0, 0, QVector<int>()};
+    const QDomNodeList chunks = layer.firstChildElement("data").elementsByTagName("chunk");
+    if(chunks.isEmpty())
+        return result;
+
+    int maxX = 0, maxY = 0;
+    for(int i = 0; i < chunks.count(); i++) {
+        const QDomElement chunk = chunks.at(i).toElement();
+        const int x = chunk.attribute("x").toInt();
+        const int y = chunk.attribute("y").toInt();
+        if(i == 0 || x < result.topLeftX) result.topLeftX = x;
+        if(i == 0 || y < result.topLeftY) result.topLeftY = y;
+        if(i == 0 || x + chunk.attribute("width").toInt() > maxX) maxX = x + chunk.attribute("width").toInt();
+        if(i == 0 || y + chunk.attribute("height").toInt() > maxY) maxY = y + chunk.attribute("height").toInt();
+    }
+    result.width = maxX - result.topLeftX;
+    result.height = maxY - result.topLeftY;
+    result.tiles.fill(0, result.width * result.height);
+
+    for(int i = 0; i < chunks.count(); i++) {
+        const QDomElement chunk = chunks.at(i).toElement();
+        const int chunkX = chunk.attribute("x").toInt() - result.topLeftX;
+        const int chunkY = chunk.attribute("y").toInt() - result.topLeftY;
+        const int chunkWidth = chunk.attribute("width").toInt();
+        const QStringList values = chunk.text().simplified().remove(' ').split(',');
+        for(int j = 0; j < values.size(); j++) {
+            const int index = (chunkY + j / chunkWidth) * result.width + chunkX + j % chunkWidth;
+            if(index < result.tiles.size())
+                result.tiles[index] = values.at(j).toInt();
+        }
+    }
+    return result;
+}
+
+/*
+ * Est-ce que le rectangle (en pixels) touche un tile de la couche.
+ * tileType à 0 accepte n'importe quel tile.
+ */
+bool GameMap::overlapsTile(const Layer &layer, const QRectF &rect, int tileType)
+{
+    const int firstX = qMax(0, qFloor(rect.left() / TILE_SIZE) - layer.topLeftX);
+    const int lastX = qMin(layer.width - 1, qCeil(rect.right() / TILE_SIZE) - 1 - layer.topLeftX);
+    const int firstY = qMax(0, qFloor(rect.top() / TILE_SIZE) - layer.topLeftY);
+    const int lastY = qMin(layer.height - 1, qCeil(rect.bottom() / TILE_SIZE) - 1 - layer.topLeftY);
+    for(int y = firstY; y <= lastY; y++) {
+        for(int x = firstX; x <= lastX; x++) {
+            const int tile = layer.tiles.at(y * layer.width + x);
+            if(tile != 0 && (tileType == 0 || tile == tileType))
+                return true;
+        }
+    }
+    return false;
+}
+
+int GameMap::getTileSize() const
+{
+    return TILE_SIZE;
+}
+
+bool GameMap::collidesWithWall(const QRectF &rect) const
+{
+    return overlapsTile(collisions, rect, 0);
+}
+
+/*
+ * Est-ce que le rectangle touche la base de l'équipe (0 rouge, 1 noire)
+ */
+bool GameMap::isInTeamSpawn(const QRectF &rect, int team) const
+{
+    if(team < 0 || team > 1 || teamSpawnTileTypes[team] == -1)
+        return false;
+    return overlapsTile(spawns, rect, teamSpawnTileTypes[team]);
+}
+
+QPointF GameMap::getTeamSpawnpoint(int team) const
+{
+    return teamSpawnpoints[team == 1 ? 1 : 0];
+}
+
+const QVector<GameMap::CandyPlacement> &GameMap::getCandyPlacements() const
+{
+    return candyPlacements;
+}
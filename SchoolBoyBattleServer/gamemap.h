@@ -0,0 +1,66 @@
+/*
+ * Description : Cette classe lit le terrain (.tmx) côté serveur et n'en
+ *               garde que ce qui sert aux règles du jeu : les murs, les
+ *               bases des équipes, les points d'apparition des joueurs et
+ *               les emplacements des candies. Elle est chargée une seule
+ *               fois et partagée, en lecture seule, par toutes les parties.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef GAMEMAP_H
+#define GAMEMAP_H
+
+#include <QDomElement>
+#include <QHash>
+#include <QPointF>
+#include <QRectF>
+#include <QString>
+#include <QVector>
+
+class GameMap
+{
+public:
+    typedef struct CandyPlacement_s {
+        QPointF pos;
+        int candyType;          // -1 si le tile n'est pas un candy connu
+        int candySize;
+        int nbPoints;
+        int respawnDelayMs;
+    } CandyPlacement;
+
+    GameMap();
+    bool load(const QString &fileName);
+    bool isLoaded() const;
+
+    int getTileSize() const;
+    bool collidesWithWall(const QRectF &rect) const;
+    bool isInTeamSpawn(const QRectF &rect, int team) const;
+    QPointF getTeamSpawnpoint(int team) const;
+    // Dans le même ordre que les TileCandyPlacement du client
+    const QVector<CandyPlacement> &getCandyPlacements() const;
+
+private:
+    // Une couche du terrain, tiles ligne par ligne
+    typedef struct Layer_s {
+        int topLeftX;
+        int topLeftY;
+        int width;
+        int height;
+        QVector<int> tiles;
+    } Layer;
+
+    bool loaded;
+    Layer collisions;
+    Layer spawns;
+    int teamSpawnTileTypes[2];
+    QPointF teamSpawnpoints[2];
+    QVector<CandyPlacement> candyPlacements;
+
+    static QHash<int, QString> readTileNames(const QDomDocument &document);
+    static Layer readLayer(const QDomElement &layer);
+    static bool overlapsTile(const Layer &layer, const QRectF &rect, int tileType);
+};
+
+#endif // GAMEMAP_H
@@ -0,0 +1,121 @@
+/*
+ * Description : Cette classe remplace MainWindow lorsque le serveur est lancé
+ *               sans interface graphique (--headless). Elle démarre le TcpServer
+ *               avec la configuration donnée, envoie les logs sur la sortie
+ *               standard et arrête proprement le serveur sur SIGTERM / SIGINT.
+ *               Avec --router, elle démarre le ShardRouter à la place.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "headlessserver.h"
+#include <QCoreApplication>
+#include <QTimer>
+
+#ifdef Q_OS_UNIX
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// Temps laissé aux workers pour fermer leurs sockets avant de quitter
+#define SHUTDOWN_GRACE_MS 500
+
+int HeadlessServer::signalFd[2] = {-1, -1};
+
+HeadlessServer::HeadlessServer(const ServerConfig &config, QObject *parent) :
+    QObject(parent),
+    config(config),
+    server(nullptr),
+    metricsServer(nullptr),
+    router(nullptr),
+    reporter(nullptr),
+    signalNotifier(nullptr)
+{
+    if(config.router) {
+        router = new ShardRouter(config, this);
+    } else {
+        server = new TcpServer(config.threadCount, config.recordDir, config.botsPerRoom, this);
+        metricsServer = new MetricsServer(server, this);
+        if(!config.routerSocket.isEmpty())
+            reporter = new ShardReporter(server, config.routerSocket, this);
+    }
+#ifdef Q_OS_UNIX
+    // On ne peut appeler aucune fonction Qt depuis un handler de signal Unix,
+    // le handler écrit donc un octet dans une socketpair que Qt surveille
+    if(signalFd[1] != -1) {
+        signalNotifier = new QSocketNotifier(signalFd[1], QSocketNotifier::Read, this);
+        // Syntaxe avec SIGNAL() car la signature de activated() change entre les versions de Qt 5
+        connect(signalNotifier, SIGNAL(activated(int)), this, SLOT(handleUnixSignal()));
+    }
+#endif
+}
+
+/*
+ * Doit être appelé avant de créer un HeadlessServer
+ */
+bool HeadlessServer::setupUnixSignalHandlers()
+{
+#ifdef Q_OS_UNIX
+    if(::socketpair(AF_UNIX, SOCK_STREAM, 0, signalFd) != 0)
+        return false;
+
+    struct sigaction action;
+    action.sa_handler = HeadlessServer::unixSignalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if(sigaction(SIGTERM, &action, nullptr) != 0)
+        return false;
+    if(sigaction(SIGINT, &action, nullptr) != 0)
+        return false;
+#endif
+    return true;
+}
+
+void HeadlessServer::unixSignalHandler(int signal)
+{
+#ifdef Q_OS_UNIX
+    char value = static_cast<char>(signal);
+    ssize_t written = ::write(signalFd[0], &value, sizeof(value));
+    Q_UNUSED(written)
+#else
+    Q_UNUSED(signal)
+#endif
+}
+
+bool HeadlessServer::start()
+{
+    if(router != nullptr)
+        return router->start();
+    if(!server->listen(config.address, config.port)) {
+        Logger::log(Logger::Error, "Impossible de démarrer le serveur : " + server->errorString());
+        return false;
+    }
+    Logger::log(Logger::Info, "Server démarré");
+    Logger::log(Logger::Info, "Adresse du serveur : " + server->serverAddress().toString());
+    Logger::log(Logger::Info, "Port : " + QString::number(server->serverPort()));
+    // Les métriques sont facultatives, le serveur de jeu tourne sans
+    if(config.metricsPort != 0)
+        metricsServer->start(config.metricsPort);
+    if(reporter != nullptr)
+        reporter->start();
+    return true;
+}
+
+void HeadlessServer::handleUnixSignal()
+{
+#ifdef Q_OS_UNIX
+    signalNotifier->setEnabled(false);
+    char value;
+    ssize_t readBytes = ::read(signalFd[1], &value, sizeof(value));
+    Q_UNUSED(readBytes)
+
+    Logger::log(Logger::Info, "Signal " + QString::number(value) + " reçu, arrêt du serveur...");
+    if(router != nullptr)
+        router->stop();
+    else
+        server->stopServer();
+    QTimer::singleShot(SHUTDOWN_GRACE_MS, QCoreApplication::instance(), &QCoreApplication::quit);
+#endif
+}
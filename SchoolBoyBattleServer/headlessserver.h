@@ -0,0 +1,50 @@
+/*
+ * Description : Cette classe remplace MainWindow lorsque le serveur est lancé
+ *               sans interface graphique (--headless). Elle démarre le TcpServer
+ *               avec la configuration donnée, envoie les logs sur la sortie
+ *               standard et arrête proprement le serveur sur SIGTERM / SIGINT.
+ *               Avec --router, elle démarre le ShardRouter à la place.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef HEADLESSSERVER_H
+#define HEADLESSSERVER_H
+
+#include "logger.h"
+#include "metricsserver.h"
+#include "serverconfig.h"
+#include "shardreporter.h"
+#include "shardrouter.h"
+#include "tcpserver.h"
+
+#include <QObject>
+#include <QSocketNotifier>
+
+class HeadlessServer : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(HeadlessServer)
+
+public:
+    HeadlessServer(const ServerConfig &config, QObject *parent = nullptr);
+    bool start();
+    static bool setupUnixSignalHandlers();
+
+private:
+    ServerConfig config;
+    TcpServer *server;
+    MetricsServer *metricsServer;
+    ShardRouter *router;            // Seulement avec --router, à la place du TcpServer
+    ShardReporter *reporter;        // Seulement dans un shard lancé par le routeur
+    QSocketNotifier *signalNotifier;
+    static int signalFd[2];
+
+    static void unixSignalHandler(int signal);
+
+private slots:
+    void handleUnixSignal();
+};
+
+#endif // HEADLESSSERVER_H
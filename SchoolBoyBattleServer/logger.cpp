@@ -0,0 +1,254 @@
+/*
+ * Description : Cette classe s'occupe des logs du serveur.
+ *               Les threads qui loggent ne font que déposer un enregistrement
+ *               binaire dans un buffer circulaire sans verrou. Un seul thread
+ *               de fond vide ce buffer, formate les messages et les écrit
+ *               (sortie standard et/ou signal logMessage pour l'interface).
+ *               Les messages sont filtrés par niveau, et les paquets peuvent
+ *               être échantillonnés par type de message (1 sur N).
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "logger.h"
+#include <QDateTime>
+#include <cstdio>
+
+#define RING_SIZE 8192          // Doit être une puissance de 2
+#define DRAIN_INTERVAL_MS 20    // Le thread de fond dort entre deux vidages
+
+Logger *Logger::self = nullptr;
+std::atomic<int> Logger::currentLevel(Logger::Info);
+
+Logger::Logger(QObject *parent) :
+    QThread(parent),
+    cells(new Cell[RING_SIZE]),
+    mask(RING_SIZE - 1),
+    enqueuePos(0),
+    dequeuePos(0),
+    dropped(0),
+    running(true),
+    stdoutEnabled(false)
+{
+    for(size_t i = 0; i < RING_SIZE; i++)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    for(int i = 0; i < Protocol::NbMessageIds; i++) {
+        samplers[i].everyN = 1;
+        samplers[i].counter.store(0, std::memory_order_relaxed);
+    }
+    self = this;
+}
+
+Logger::~Logger()
+{
+    stop();
+    self = nullptr;
+    delete[] cells;
+}
+
+Logger *Logger::instance()
+{
+    return self;
+}
+
+void Logger::setLevel(int level)
+{
+    currentLevel.store(level, std::memory_order_relaxed);
+}
+
+/*
+ * Ne garder qu'un paquet sur everyN pour ce type de message.
+ * Doit être appelé avant de démarrer le serveur.
+ */
+void Logger::setSampling(const QString &messageType, int everyN)
+{
+    const int messageId = Protocol::idFromName(messageType);
+    if(messageId < 0) {
+        log(Warning, "Type de message inconnu pour l'échantillonnage : " + messageType);
+        return;
+    }
+    samplers[messageId].everyN = qMax(everyN, 1);
+}
+
+void Logger::setStdoutEnabled(bool enabled)
+{
+    stdoutEnabled = enabled;
+}
+
+/*
+ * Arrête le thread de fond après avoir écrit tout ce qui reste
+ */
+void Logger::stop()
+{
+    if(!isRunning())
+        return;
+    running.store(false, std::memory_order_release);
+    wait();
+}
+
+bool Logger::isSampled(int messageId)
+{
+    if(self == nullptr || !Protocol::isValid(messageId))
+        return false;
+    Sampler &sampler = self->samplers[messageId];
+    if(sampler.everyN <= 1)
+        return true;
+    return sampler.counter.fetch_add(1, std::memory_order_relaxed) % sampler.everyN == 0;
+}
+
+void Logger::log(int level, const QString &text)
+{
+    if(self == nullptr || !isEnabled(level))
+        return;
+    Record record;
+    record.timestamp = QDateTime::currentMSecsSinceEpoch();
+    record.level = level;
+    record.event = Text;
+    record.descriptor = -1;
+    record.text = text;
+    self->push(record);
+}
+
+/*
+ * Le payload est gardé tel quel (brut), il ne sera converti en texte
+ * que par le thread de fond
+ */
+void Logger::logPacket(int level, Event event, qintptr descriptor, const QByteArray &payload)
+{
+    if(self == nullptr || !isEnabled(level))
+        return;
+    Record record;
+    record.timestamp = QDateTime::currentMSecsSinceEpoch();
+    record.level = level;
+    record.event = event;
+    record.descriptor = descriptor;
+    record.payload = payload;
+    self->push(record);
+}
+
+// BUFFER CIRCULAIRE ------------------------------------------------------------------------
+
+/*
+ * Plusieurs producteurs : chaque case a un numéro de séquence qui indique
+ * si elle est libre pour la position qu'on veut réserver.
+ * Si le buffer est plein, l'enregistrement est perdu (on ne bloque jamais).
+ */
+bool Logger::push(Record &record)
+{
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Cell *cell;
+    while(true) {
+        cell = &cells[pos & mask];
+        const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        const qintptr diff = static_cast<qintptr>(sequence) - static_cast<qintptr>(pos);
+        if(diff == 0) {
+            if(enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if(diff < 0) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    cell->record = std::move(record);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+/*
+ * Un seul consommateur : le thread de fond
+ */
+bool Logger::pop(Record &record)
+{
+    Cell *cell = &cells[dequeuePos & mask];
+    const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    if(static_cast<qintptr>(sequence) - static_cast<qintptr>(dequeuePos + 1) < 0)
+        return false;
+    record = std::move(cell->record);
+    cell->sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+    dequeuePos++;
+    return true;
+}
+
+// THREAD DE FOND ---------------------------------------------------------------------------
+
+void Logger::run()
+{
+    while(running.load(std::memory_order_acquire)) {
+        if(drain() == 0)
+            msleep(DRAIN_INTERVAL_MS);
+    }
+    drain();
+}
+
+/*
+ * Formate tous les enregistrements en attente et les écrit en un seul bloc
+ */
+int Logger::drain()
+{
+    Record record;
+    QString batch;
+    int count = 0;
+    while(pop(record)) {
+        if(count > 0)
+            batch += '\n';
+        batch += format(record);
+        count++;
+    }
+
+    const quint64 nbDropped = dropped.exchange(0, std::memory_order_relaxed);
+    if(nbDropped > 0) {
+        if(count > 0)
+            batch += '\n';
+        batch += QString::number(nbDropped) + " message(s) de log perdu(s), buffer plein";
+        count++;
+    }
+
+    if(count == 0)
+        return 0;
+    if(stdoutEnabled) {
+        const QByteArray output = batch.toUtf8() + '\n';
+        fwrite(output.constData(), 1, output.size(), stdout);
+        fflush(stdout);
+    }
+    emit logMessage(batch);
+    return count;
+}
+
+/*
+ * Le payload commence par l'id du message, suivi du JSON
+ */
+QString Logger::formatPayload(const QByteArray &payload)
+{
+    if(payload.isEmpty())
+        return QString();
+    return Protocol::name(static_cast<quint8>(payload.at(0))) + " " + QString::fromUtf8(payload.mid(1));
+}
+
+QString Logger::format(const Record &record)
+{
+    static const char *levels[] = {"ERROR", "WARN ", "INFO ", "DEBUG"};
+    QString line = QDateTime::fromMSecsSinceEpoch(record.timestamp).toString("hh:mm:ss.zzz")
+            + " [" + levels[qBound(0, record.level, 3)] + "] ";
+
+    switch(record.event) {
+    case Text:
+        line += record.text;
+        break;
+    case PacketIn:
+        line += "Message recu de " + QString::number(record.descriptor) + " : " + formatPayload(record.payload);
+        break;
+    case PacketOut:
+        if(record.descriptor < 0)
+            line += "Envoi à tous - " + formatPayload(record.payload);
+        else
+            line += "Envoi à " + QString::number(record.descriptor) + " - " + formatPayload(record.payload);
+        break;
+    case InvalidPacket:
+        line += "Message invalide de " + QString::number(record.descriptor) + " : " + QString::fromUtf8(record.payload);
+        break;
+    }
+    return line;
+}
@@ -0,0 +1,96 @@
+/*
+ * Description : Cette classe s'occupe des logs du serveur.
+ *               Les threads qui loggent ne font que déposer un enregistrement
+ *               binaire dans un buffer circulaire sans verrou. Un seul thread
+ *               de fond vide ce buffer, formate les messages et les écrit
+ *               (sortie standard et/ou signal logMessage pour l'interface).
+ *               Les messages sont filtrés par niveau, et les paquets peuvent
+ *               être échantillonnés par type de message (1 sur N).
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "protocol.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QThread>
+#include <atomic>
+
+class Logger : public QThread
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(Logger)
+
+public:
+    enum Level : int {Error = 0, Warning = 1, Info = 2, Debug = 3};
+    // Les enregistrements sont typés, le texte n'est construit qu'à l'écriture
+    enum Event : int {Text, PacketIn, PacketOut, InvalidPacket};
+
+    Logger(QObject *parent = nullptr);
+    ~Logger();
+    static Logger *instance();
+
+    void setLevel(int level);
+    void setSampling(const QString &messageType, int everyN);
+    void setStdoutEnabled(bool enabled);
+    void stop();
+
+    static inline bool isEnabled(int level) {
+        return level <= currentLevel.load(std::memory_order_relaxed);
+    }
+    static bool isSampled(int messageId);
+    static void log(int level, const QString &text);
+    static void logPacket(int level, Event event, qintptr descriptor, const QByteArray &payload);
+
+protected:
+    void run() override;
+
+private:
+    typedef struct Record_s {
+        qint64 timestamp;
+        int level;
+        Event event;
+        qintptr descriptor;
+        QString text;
+        QByteArray payload;     // Partagé implicitement, pas de copie
+    } Record;
+
+    typedef struct Cell_s {
+        std::atomic<size_t> sequence;
+        Record record;
+    } Cell;
+
+    typedef struct Sampler_s {
+        int everyN;
+        std::atomic<unsigned int> counter;
+    } Sampler;
+
+    static Logger *self;
+    static std::atomic<int> currentLevel;
+
+    Cell *cells;
+    const size_t mask;
+    std::atomic<size_t> enqueuePos;
+    size_t dequeuePos;
+    std::atomic<quint64> dropped;
+    std::atomic<bool> running;
+    bool stdoutEnabled;
+    // Rempli avant le démarrage du serveur, en lecture seule ensuite
+    Sampler samplers[Protocol::NbMessageIds];
+
+    bool push(Record &record);
+    bool pop(Record &record);
+    int drain();
+    static QString format(const Record &record);
+    static QString formatPayload(const QByteArray &payload);
+
+signals:
+    void logMessage(const QString &msg);
+};
+
+#endif // LOGGER_H
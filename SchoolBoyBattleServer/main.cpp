@@ -1,19 +1,56 @@
 /*
  * Description : Cette classe permet de lancer notre application.
+ *               Avec l'option --headless, le serveur démarre sans interface
+ *               graphique (QCoreApplication) et sans MainWindow.
  * Version     : 1.0.0
  * Date        : 25.01.2021
  * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
 */
 
+#include "headlessserver.h"
+#include "logger.h"
 #include "mainwindow.h"
+#include "serverconfig.h"
 
 #include <QApplication>
+#include <QCoreApplication>
+
+/*
+ * Le Logger doit exister avant le serveur et être détruit après lui
+ */
+static void setupLogger(Logger *logger, const ServerConfig &config)
+{
+    logger->setLevel(config.logLevel);
+    QHashIterator<QString, int> i(config.logSampling);
+    while(i.hasNext()) {
+        i.next();
+        logger->setSampling(i.key(), i.value());
+    }
+    logger->start();
+}
 
 int main(int argc, char *argv[])
 {
     srand(time(NULL));
+
+    if(ServerConfig::isHeadless(argc, argv)) {
+        QCoreApplication a(argc, argv);
+        const ServerConfig config = ServerConfig::fromArguments(a.arguments());
+        Logger logger;
+        logger.setStdoutEnabled(true);
+        setupLogger(&logger, config);
+        HeadlessServer::setupUnixSignalHandlers();
+        HeadlessServer server(config);
+        if(!server.start())
+            return 1;
+        return a.exec();
+    }
+
     QApplication a(argc, argv);
-    MainWindow w;
+    const ServerConfig config = ServerConfig::fromArguments(a.arguments());
+    Logger logger;
+    setupLogger(&logger, config);
+    MainWindow w(config);
     w.resize(600, 400);
     w.show();
     return a.exec();
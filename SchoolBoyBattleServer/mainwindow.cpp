@@ -13,9 +13,14 @@
 #include <QMessageBox>
 #include <QFont>
 
-MainWindow::MainWindow(QWidget *parent)
+// Nombre de lignes gardées dans le log, les plus anciennes sont supprimées
+#define MAX_LOG_LINES 5000
+
+MainWindow::MainWindow(const ServerConfig &config, QWidget *parent)
     : QMainWindow(parent),
-      server(new TcpServer(this))
+      config(config),
+      server(new TcpServer(config.threadCount, config.recordDir, config.botsPerRoom, this)),
+      metricsServer(new MetricsServer(server, this))
 {
     // Construction du widget
     QWidget *mainWidget = new QWidget(this);
@@ -24,6 +29,8 @@ MainWindow::MainWindow(QWidget *parent)
 
     editText = new QPlainTextEdit;
     editText->setFont(*(new QFont("Courier New", 10, QFont::Bold)));
+    editText->setReadOnly(true);
+    editText->setMaximumBlockCount(MAX_LOG_LINES);
     btnToggleServer = new QPushButton("Démarrer");
 
     btnLayout->addStretch(1);
@@ -34,7 +41,9 @@ MainWindow::MainWindow(QWidget *parent)
     setCentralWidget(mainWidget);
 
     connect(btnToggleServer, &QPushButton::clicked, this, &MainWindow::toggleServer);
-    connect(server, &TcpServer::logMessage, this, &MainWindow::logMessage);
+    // Les logs sont formatés par le thread du Logger et arrivent par paquets
+    if(Logger::instance() != nullptr)
+        connect(Logger::instance(), &Logger::logMessage, this, &MainWindow::logMessage);
 
     logMessage(QString("  _____________________________  _________\n") +
                " /   _____/\\______   \\______   \\/   _____/\n" +
@@ -43,6 +52,9 @@ MainWindow::MainWindow(QWidget *parent)
                "/_______  / |______  /|______  /_______  /\n" +
                "        \\/         \\/        \\/        \\/ \n");
     logMessage("---------------------\nSchoolBoyBattleServer\n---------------------");
+
+    if(config.metricsPort != 0)
+        metricsServer->start(config.metricsPort);
 }
 
 void MainWindow::logMessage(const QString &msg)
@@ -57,7 +69,7 @@ void MainWindow::toggleServer()
         btnToggleServer->setText("Démarrer");
         logMessage("Server stoppé\n---------------------");
     } else {
-        if(!server->listen(QHostAddress::Any, 1962)) {
+        if(!server->listen(config.address, config.port)) {
             QMessageBox::critical(this, "Erreur", "Impossible de démarrer le serveur");
             return;
         }
@@ -10,6 +10,8 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include "metricsserver.h"
+#include "serverconfig.h"
 #include "tcpserver.h"
 
 #include <QMainWindow>
@@ -22,12 +24,14 @@ class MainWindow : public QMainWindow
     Q_DISABLE_COPY(MainWindow)
 
 public:
-    MainWindow(QWidget *parent = nullptr);
+    MainWindow(const ServerConfig &config, QWidget *parent = nullptr);
 
 private:
+    ServerConfig config;
     QPlainTextEdit *editText;
     QPushButton *btnToggleServer;
     TcpServer *server;
+    MetricsServer *metricsServer;
 
 private slots:
     void logMessage(const QString &msg);
@@ -0,0 +1,109 @@
+/*
+ * Description : Cette classe est la file d'attente des clients loggés qui
+ *               n'ont pas encore de partie. Chaque client choisit la taille
+ *               de partie qu'il préfère, il y a donc une file par taille.
+ *               Le TcpServer en retire les clients par groupes pour remplir
+ *               ses parties, toujours les plus anciens d'abord.
+ *               Utilisée uniquement dans le thread du TcpServer.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "matchmaker.h"
+
+#define MIN_ROOM_SIZE 2
+#define MAX_ROOM_SIZE 8
+#define DEFAULT_ROOM_SIZE MAX_ROOM_SIZE     // Les parties pleines occupent le mieux le serveur
+#define MAX_QUEUED_CLIENTS 4000
+
+/*
+ * Des équipes égales : seules les tailles paires sont acceptées
+ */
+int Matchmaker::parseRoomSize(int roomSize)
+{
+    if(roomSize < MIN_ROOM_SIZE || roomSize > MAX_ROOM_SIZE || roomSize % 2 != 0)
+        return DEFAULT_ROOM_SIZE;
+    return roomSize;
+}
+
+QList<int> Matchmaker::roomSizes()
+{
+    QList<int> sizes;
+    for(int roomSize = MAX_ROOM_SIZE; roomSize >= MIN_ROOM_SIZE; roomSize -= 2)
+        sizes.append(roomSize);
+    return sizes;
+}
+
+/*
+ * Retourne false si la file est pleine
+ */
+bool Matchmaker::enqueue(const Ticket &ticket)
+{
+    if(queuedClients.size() >= MAX_QUEUED_CLIENTS || queuedClients.contains(ticket.client))
+        return false;
+    queues[ticket.roomSize].append(ticket);
+    queuedClients.insert(ticket.client, ticket.roomSize);
+    return true;
+}
+
+bool Matchmaker::remove(ServerWorker *client)
+{
+    if(!queuedClients.contains(client))
+        return false;
+    QList<Ticket> &queue = queues[queuedClients.take(client)];
+    for(int i = 0; i < queue.size(); i++) {
+        if(queue.at(i).client == client) {
+            queue.removeAt(i);
+            break;
+        }
+    }
+    return true;
+}
+
+bool Matchmaker::contains(ServerWorker *client) const
+{
+    return queuedClients.contains(client);
+}
+
+int Matchmaker::size() const
+{
+    return queuedClients.size();
+}
+
+int Matchmaker::size(int roomSize) const
+{
+    return queues.value(roomSize).size();
+}
+
+/*
+ * Retourne -1 si personne n'attend une partie de cette taille
+ */
+qint64 Matchmaker::oldestQueuedAtMs(int roomSize) const
+{
+    const QList<Ticket> queue = queues.value(roomSize);
+    return queue.isEmpty() ? -1 : queue.first().queuedAtMs;
+}
+
+QList<Matchmaker::Ticket> Matchmaker::take(int roomSize, int count, const std::function<bool(const QString &)> &refused)
+{
+    QList<Ticket> taken;
+    if(!queues.contains(roomSize))
+        return taken;
+    QList<Ticket> &queue = queues[roomSize];
+    for(int i = 0; i < queue.size() && taken.size() < count;) {
+        const Ticket &ticket = queue.at(i);
+        bool duplicate = refused && refused(ticket.username);
+        for(int j = 0; j < taken.size() && !duplicate; j++)
+            duplicate = taken.at(j).username.compare(ticket.username, Qt::CaseInsensitive) == 0;
+        // Il garde sa place pour la prochaine partie
+        if(duplicate) {
+            i++;
+            continue;
+        }
+        taken.append(ticket);
+        queuedClients.remove(ticket.client);
+        queue.removeAt(i);
+    }
+    return taken;
+}
@@ -0,0 +1,51 @@
+/*
+ * Description : Cette classe est la file d'attente des clients loggés qui
+ *               n'ont pas encore de partie. Chaque client choisit la taille
+ *               de partie qu'il préfère, il y a donc une file par taille.
+ *               Le TcpServer en retire les clients par groupes pour remplir
+ *               ses parties, toujours les plus anciens d'abord.
+ *               Utilisée uniquement dans le thread du TcpServer.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef MATCHMAKER_H
+#define MATCHMAKER_H
+
+#include "serverworker.h"
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <functional>
+
+class Matchmaker
+{
+public:
+    typedef struct Ticket_s {
+        ServerWorker *client;
+        QString username;
+        int roomSize;           // Taille de partie préférée
+        qint64 queuedAtMs;
+    } Ticket;
+
+    static int parseRoomSize(int roomSize);
+    static QList<int> roomSizes();
+
+    bool enqueue(const Ticket &ticket);
+    bool remove(ServerWorker *client);
+    bool contains(ServerWorker *client) const;
+    int size() const;
+    int size(int roomSize) const;
+    qint64 oldestQueuedAtMs(int roomSize) const;
+    // Retire au plus count clients de cette taille, les plus anciens d'abord,
+    // sans deux fois le même username ni un username refusé
+    QList<Ticket> take(int roomSize, int count, const std::function<bool(const QString &)> &refused = nullptr);
+
+private:
+    QHash<int, QList<Ticket>> queues;  // Par taille de partie, du plus ancien au plus récent
+    QHash<ServerWorker *, int> queuedClients;   // Client -> taille de sa file
+};
+
+#endif // MATCHMAKER_H
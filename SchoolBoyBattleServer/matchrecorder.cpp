@@ -0,0 +1,144 @@
+/*
+ * Description : Cette classe enregistre une partie dans un fichier binaire
+ *               en ajout seul : tous les messages reçus des clients, tous
+ *               les paquets envoyés, et le début de chaque pas avec son
+ *               heure. Les enregistrements sont accumulés en mémoire et
+ *               confiés par gros blocs au RecordWriter, qui écrit dans son
+ *               propre thread. Un index des pas est ajouté à la fermeture.
+ *               Format (entiers en big endian) :
+ *               En-tête       : "SBBR" [version quint16][partie quint32][début ms qint64]
+ *               Enregistrement: [type quint8][pas quint32][descriptor qint64][taille quint32][données]
+ *               Index         : un enregistrement Index, [pas quint32][position quint64]...
+ *               Fin           : [position de l'index quint64] "SBBI"
+ *               Sans fin de fichier (arrêt brutal), il se lit quand même
+ *               enregistrement par enregistrement.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "matchrecorder.h"
+#include "logger.h"
+#include "protocol.h"
+#include <QDateTime>
+#include <QtEndian>
+
+#define RECORD_VERSION 1
+#define FLUSH_BYTES (256 * 1024)        // Taille des blocs confiés au RecordWriter
+#define FLUSH_INTERVAL_MS 2000          // Une partie calme est quand même écrite régulièrement
+#define INDEX_INTERVAL_TICKS 30         // Une entrée d'index par seconde de jeu
+
+template <typename T>
+static void appendBigEndian(QByteArray &buffer, T value)
+{
+    uchar bytes[sizeof(T)];
+    qToBigEndian<T>(value, bytes);
+    buffer.append(reinterpret_cast<const char *>(bytes), sizeof(T));
+}
+
+MatchRecorder::MatchRecorder(RecordWriter *writer, int roomId) :
+    writer(writer),
+    closed(false),
+    offset(0),
+    currentTick(0),
+    lostBytes(0)
+{
+    const QDateTime now = QDateTime::currentDateTime();
+    fileId = writer->open("room-" + QString::number(roomId) + "-" + now.toString("yyyyMMdd-hhmmss") + ".sbbr");
+    buffer.reserve(FLUSH_BYTES + FLUSH_BYTES / 4);
+    buffer.append("SBBR", 4);
+    appendBigEndian<quint16>(buffer, RECORD_VERSION);
+    appendBigEndian<quint32>(buffer, quint32(roomId));
+    appendBigEndian<qint64>(buffer, now.toMSecsSinceEpoch());
+    clock.start();
+    lastFlush.start();
+}
+
+MatchRecorder::~MatchRecorder()
+{
+    close();
+}
+
+void MatchRecorder::append(RecordType type, qintptr descriptor, const QByteArray &data)
+{
+    appendBigEndian<quint8>(buffer, type);
+    appendBigEndian<quint32>(buffer, currentTick);
+    appendBigEndian<qint64>(buffer, descriptor);
+    appendBigEndian<quint32>(buffer, quint32(data.size()));
+    buffer.append(data);
+}
+
+/*
+ * Début d'un pas : les enregistrements suivants portent ce numéro
+ */
+void MatchRecorder::tick(quint32 tick)
+{
+    currentTick = tick;
+    if(tick % INDEX_INTERVAL_TICKS == 0)
+        index.append(IndexEntry{tick, offset + buffer.size()});
+    QByteArray elapsed;
+    appendBigEndian<qint64>(elapsed, clock.nsecsElapsed());
+    append(Tick, -1, elapsed);
+}
+
+/*
+ * Le message est réencodé comme le client l'a envoyé (id et JSON compact)
+ */
+void MatchRecorder::inbound(qintptr descriptor, int messageId, const QJsonObject &message)
+{
+    if(closed || !Protocol::isValid(messageId))
+        return;
+    append(Inbound, descriptor, Protocol::encode(static_cast<Protocol::MessageId>(messageId), message));
+}
+
+void MatchRecorder::outbound(qintptr descriptor, const QByteArray &packet)
+{
+    if(closed)
+        return;
+    append(Outbound, descriptor, packet);
+}
+
+/*
+ * Confie le buffer au RecordWriter s'il est assez gros, ou s'il attend
+ * depuis trop longtemps. Ne touche jamais le disque.
+ */
+void MatchRecorder::flush(bool force)
+{
+    if(buffer.isEmpty())
+        return;
+    if(!force && buffer.size() < FLUSH_BYTES && lastFlush.elapsed() < FLUSH_INTERVAL_MS)
+        return;
+    // Un bloc perdu décale les positions de l'index, on le signale une fois
+    if(!writer->append(fileId, buffer)) {
+        if(lostBytes == 0)
+            Logger::log(Logger::Warning, "Le disque ne suit pas, l'enregistrement de la partie est incomplet");
+        lostBytes += buffer.size();
+    } else {
+        offset += buffer.size();
+    }
+    buffer.clear();
+    buffer.reserve(FLUSH_BYTES + FLUSH_BYTES / 4);
+    lastFlush.restart();
+}
+
+/*
+ * Ajoute l'index et la fin du fichier, puis ferme le fichier
+ */
+void MatchRecorder::close()
+{
+    if(closed)
+        return;
+    const quint64 indexOffset = offset + buffer.size();
+    QByteArray entries;
+    entries.reserve(index.size() * 12);
+    for(int i = 0; i < index.size(); i++) {
+        appendBigEndian<quint32>(entries, index.at(i).tick);
+        appendBigEndian<quint64>(entries, index.at(i).offset);
+    }
+    append(Index, -1, entries);
+    appendBigEndian<quint64>(buffer, indexOffset);
+    buffer.append("SBBI", 4);
+    flush(true);
+    writer->close(fileId);
+    closed = true;
+}
@@ -0,0 +1,71 @@
+/*
+ * Description : Cette classe enregistre une partie dans un fichier binaire
+ *               en ajout seul : tous les messages reçus des clients, tous
+ *               les paquets envoyés, et le début de chaque pas avec son
+ *               heure. Les enregistrements sont accumulés en mémoire et
+ *               confiés par gros blocs au RecordWriter, qui écrit dans son
+ *               propre thread. Un index des pas est ajouté à la fermeture.
+ *               Format (entiers en big endian) :
+ *               En-tête       : "SBBR" [version quint16][partie quint32][début ms qint64]
+ *               Enregistrement: [type quint8][pas quint32][descriptor qint64][taille quint32][données]
+ *               Index         : un enregistrement Index, [pas quint32][position quint64]...
+ *               Fin           : [position de l'index quint64] "SBBI"
+ *               Sans fin de fichier (arrêt brutal), il se lit quand même
+ *               enregistrement par enregistrement.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef MATCHRECORDER_H
+#define MATCHRECORDER_H
+
+#include "recordwriter.h"
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QVector>
+
+class MatchRecorder
+{
+    Q_DISABLE_COPY(MatchRecorder)
+
+public:
+    enum RecordType : quint8 {
+        Tick = 1,               // Données : temps depuis le début en ns (qint64)
+        Inbound = 2,            // Données : [id][JSON] reçu du client descriptor
+        Outbound = 3,           // Données : paquet envoyé, descriptor -1 pour tout le monde
+        Index = 4
+    };
+
+    MatchRecorder(RecordWriter *writer, int roomId);
+    ~MatchRecorder();
+
+    void tick(quint32 tick);
+    void inbound(qintptr descriptor, int messageId, const QJsonObject &message);
+    void outbound(qintptr descriptor, const QByteArray &packet);
+    void flush(bool force = false);
+    void close();
+
+private:
+    typedef struct IndexEntry_s {
+        quint32 tick;
+        quint64 offset;
+    } IndexEntry;
+
+    RecordWriter *writer;
+    int fileId;
+    bool closed;
+    QByteArray buffer;
+    quint64 offset;             // Position dans le fichier du début de buffer
+    quint32 currentTick;
+    QElapsedTimer clock;
+    QElapsedTimer lastFlush;
+    QVector<IndexEntry> index;
+    quint64 lostBytes;
+
+    void append(RecordType type, qintptr descriptor, const QByteArray &data);
+};
+
+#endif // MATCHRECORDER_H
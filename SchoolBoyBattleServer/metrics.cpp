@@ -0,0 +1,232 @@
+/*
+ * Description : Cette classe compte les messages et octets reçus / envoyés
+ *               par type de message, et le temps de traitement des messages.
+ *               Chaque thread a ses propres compteurs, qu'il est le seul à
+ *               écrire (pas de verrou, pas d'instruction atomique coûteuse).
+ *               Les compteurs de tous les threads ne sont additionnés qu'au
+ *               moment de la lecture (render), au format texte Prometheus.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "metrics.h"
+#include <QMutexLocker>
+#include <cstring>
+
+// Limites des buckets de l'histogramme des temps de traitement (en nanosecondes)
+static const qint64 latencyLimitsNs[NB_LATENCY_BUCKETS] = {
+    10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000, 25000000, 100000000
+};
+
+QMutex Metrics::registryLock;
+QVector<Metrics::ThreadCounters *> Metrics::registry;
+
+/*
+ * Les compteurs du thread courant, créés à sa première utilisation
+ */
+Metrics::ThreadCounters *Metrics::local()
+{
+    static thread_local ThreadCounters *counters = nullptr;
+    if(counters == nullptr) {
+        counters = new ThreadCounters;
+        for(int i = 0; i < Protocol::NbMessageIds; i++) {
+            counters->messagesIn[i].store(0, std::memory_order_relaxed);
+            counters->bytesIn[i].store(0, std::memory_order_relaxed);
+            counters->messagesOut[i].store(0, std::memory_order_relaxed);
+            counters->bytesOut[i].store(0, std::memory_order_relaxed);
+            counters->messagesDropped[i].store(0, std::memory_order_relaxed);
+            counters->messagesRateLimited[i].store(0, std::memory_order_relaxed);
+            counters->latencySumNs[i].store(0, std::memory_order_relaxed);
+            for(int j = 0; j <= NB_LATENCY_BUCKETS; j++)
+                counters->latencyBuckets[i][j].store(0, std::memory_order_relaxed);
+        }
+        counters->socketWrites.store(0, std::memory_order_relaxed);
+        counters->socketWriteBytes.store(0, std::memory_order_relaxed);
+        counters->invalidMessages.store(0, std::memory_order_relaxed);
+        counters->invalidBytes.store(0, std::memory_order_relaxed);
+        counters->idleDisconnects.store(0, std::memory_order_relaxed);
+        counters->ticksOverBudget.store(0, std::memory_order_relaxed);
+        for(int i = 0; i < NB_LOAD_LEVELS; i++)
+            counters->roomOverloads[i].store(0, std::memory_order_relaxed);
+
+        QMutexLocker locker(&registryLock);
+        registry.append(counters);
+    }
+    return counters;
+}
+
+void Metrics::messageIn(int messageId, int bytes)
+{
+    ThreadCounters *counters = local();
+    add(counters->messagesIn[messageId], 1);
+    add(counters->bytesIn[messageId], bytes);
+}
+
+void Metrics::invalidMessageIn(int bytes)
+{
+    ThreadCounters *counters = local();
+    add(counters->invalidMessages, 1);
+    add(counters->invalidBytes, bytes);
+}
+
+void Metrics::idleDisconnect()
+{
+    add(local()->idleDisconnects, 1);
+}
+
+void Metrics::tickOverBudget()
+{
+    add(local()->ticksOverBudget, 1);
+}
+
+void Metrics::roomOverload(int level)
+{
+    if(level > 0 && level < NB_LOAD_LEVELS)
+        add(local()->roomOverloads[level], 1);
+}
+
+void Metrics::messageOut(int messageId, int bytes)
+{
+    ThreadCounters *counters = local();
+    add(counters->messagesOut[messageId], 1);
+    add(counters->bytesOut[messageId], bytes);
+}
+
+void Metrics::messagesDropped(int messageId, int count)
+{
+    add(local()->messagesDropped[messageId], count);
+}
+
+/*
+ * Message reçu mais ignoré car le client en envoie trop
+ */
+void Metrics::messageRateLimited(int messageId)
+{
+    add(local()->messagesRateLimited[messageId], 1);
+}
+
+/*
+ * Une écriture dans un socket, qui peut contenir plusieurs messages
+ */
+void Metrics::socketWrite(int bytes)
+{
+    ThreadCounters *counters = local();
+    add(counters->socketWrites, 1);
+    add(counters->socketWriteBytes, bytes);
+}
+
+void Metrics::handlerLatency(int messageId, qint64 nsecs)
+{
+    ThreadCounters *counters = local();
+    int bucket = 0;
+    while(bucket < NB_LATENCY_BUCKETS && nsecs > latencyLimitsNs[bucket])
+        bucket++;
+    add(counters->latencyBuckets[messageId][bucket], 1);
+    add(counters->latencySumNs[messageId], nsecs);
+}
+
+/*
+ * Additionne les compteurs de tous les threads. Les valeurs d'un thread
+ * peuvent avoir un message d'avance entre deux compteurs, ce n'est pas grave.
+ */
+QString Metrics::render()
+{
+    quint64 messagesIn[Protocol::NbMessageIds] = {};
+    quint64 bytesIn[Protocol::NbMessageIds] = {};
+    quint64 messagesOut[Protocol::NbMessageIds] = {};
+    quint64 bytesOut[Protocol::NbMessageIds] = {};
+    quint64 messagesDropped[Protocol::NbMessageIds] = {};
+    quint64 messagesRateLimited[Protocol::NbMessageIds] = {};
+    quint64 latencyBuckets[Protocol::NbMessageIds][NB_LATENCY_BUCKETS + 1];
+    quint64 latencySumNs[Protocol::NbMessageIds] = {};
+    quint64 socketWrites = 0;
+    quint64 socketWriteBytes = 0;
+    quint64 invalidMessages = 0;
+    quint64 invalidBytes = 0;
+    quint64 idleDisconnects = 0;
+    quint64 ticksOverBudget = 0;
+    quint64 roomOverloads[NB_LOAD_LEVELS] = {};
+    memset(latencyBuckets, 0, sizeof(latencyBuckets));
+
+    registryLock.lock();
+    for(const ThreadCounters *counters : qAsConst(registry)) {
+        for(int i = 0; i < Protocol::NbMessageIds; i++) {
+            messagesIn[i] += counters->messagesIn[i].load(std::memory_order_relaxed);
+            bytesIn[i] += counters->bytesIn[i].load(std::memory_order_relaxed);
+            messagesOut[i] += counters->messagesOut[i].load(std::memory_order_relaxed);
+            bytesOut[i] += counters->bytesOut[i].load(std::memory_order_relaxed);
+            messagesDropped[i] += counters->messagesDropped[i].load(std::memory_order_relaxed);
+            messagesRateLimited[i] += counters->messagesRateLimited[i].load(std::memory_order_relaxed);
+            latencySumNs[i] += counters->latencySumNs[i].load(std::memory_order_relaxed);
+            for(int j = 0; j <= NB_LATENCY_BUCKETS; j++)
+                latencyBuckets[i][j] += counters->latencyBuckets[i][j].load(std::memory_order_relaxed);
+        }
+        socketWrites += counters->socketWrites.load(std::memory_order_relaxed);
+        socketWriteBytes += counters->socketWriteBytes.load(std::memory_order_relaxed);
+        invalidMessages += counters->invalidMessages.load(std::memory_order_relaxed);
+        invalidBytes += counters->invalidBytes.load(std::memory_order_relaxed);
+        idleDisconnects += counters->idleDisconnects.load(std::memory_order_relaxed);
+        ticksOverBudget += counters->ticksOverBudget.load(std::memory_order_relaxed);
+        for(int i = 0; i < NB_LOAD_LEVELS; i++)
+            roomOverloads[i] += counters->roomOverloads[i].load(std::memory_order_relaxed);
+    }
+    registryLock.unlock();
+
+    QString text;
+    text += "# TYPE sbb_messages_in_total counter\n";
+    for(int i = 0; i < Protocol::NbMessageIds; i++)
+        text += "sbb_messages_in_total{type=\"" + Protocol::name(i) + "\"} " + QString::number(messagesIn[i]) + '\n';
+    text += "# TYPE sbb_bytes_in_total counter\n";
+    for(int i = 0; i < Protocol::NbMessageIds; i++)
+        text += "sbb_bytes_in_total{type=\"" + Protocol::name(i) + "\"} " + QString::number(bytesIn[i]) + '\n';
+    text += "# TYPE sbb_messages_rate_limited_total counter\n";
+    for(int i = 0; i < Protocol::NbMessageIds; i++)
+        text += "sbb_messages_rate_limited_total{type=\"" + Protocol::name(i) + "\"} " + QString::number(messagesRateLimited[i]) + '\n';
+    text += "# TYPE sbb_invalid_messages_in_total counter\n";
+    text += "sbb_invalid_messages_in_total " + QString::number(invalidMessages) + '\n';
+    text += "# TYPE sbb_invalid_bytes_in_total counter\n";
+    text += "sbb_invalid_bytes_in_total " + QString::number(invalidBytes) + '\n';
+    text += "# TYPE sbb_idle_disconnects_total counter\n";
+    text += "sbb_idle_disconnects_total " + QString::number(idleDisconnects) + '\n';
+    text += "# TYPE sbb_ticks_over_budget_total counter\n";
+    text += "sbb_ticks_over_budget_total " + QString::number(ticksOverBudget) + '\n';
+    text += "# TYPE sbb_room_overload_events_total counter\n";
+    for(int i = 1; i < NB_LOAD_LEVELS; i++)
+        text += "sbb_room_overload_events_total{level=\"" + QString::number(i) + "\"} " + QString::number(roomOverloads[i]) + '\n';
+    text += "# TYPE sbb_messages_out_total counter\n";
+    for(int i = 0; i < Protocol::NbMessageIds; i++)
+        text += "sbb_messages_out_total{type=\"" + Protocol::name(i) + "\"} " + QString::number(messagesOut[i]) + '\n';
+    text += "# TYPE sbb_bytes_out_total counter\n";
+    for(int i = 0; i < Protocol::NbMessageIds; i++)
+        text += "sbb_bytes_out_total{type=\"" + Protocol::name(i) + "\"} " + QString::number(bytesOut[i]) + '\n';
+    text += "# TYPE sbb_socket_writes_total counter\n";
+    text += "sbb_socket_writes_total " + QString::number(socketWrites) + '\n';
+    text += "# TYPE sbb_socket_write_bytes_total counter\n";
+    text += "sbb_socket_write_bytes_total " + QString::number(socketWriteBytes) + '\n';
+    text += "# TYPE sbb_messages_dropped_total counter\n";
+    for(int i = 0; i < Protocol::NbMessageIds; i++)
+        text += "sbb_messages_dropped_total{type=\"" + Protocol::name(i) + "\"} " + QString::number(messagesDropped[i]) + '\n';
+
+    // Histogramme cumulatif, seulement pour les types de messages reçus
+    text += "# TYPE sbb_handler_duration_seconds histogram\n";
+    for(int i = 0; i < Protocol::NbMessageIds; i++) {
+        quint64 count = 0;
+        for(int j = 0; j <= NB_LATENCY_BUCKETS; j++)
+            count += latencyBuckets[i][j];
+        if(count == 0)
+            continue;
+        const QString type = Protocol::name(i);
+        quint64 cumulative = 0;
+        for(int j = 0; j < NB_LATENCY_BUCKETS; j++) {
+            cumulative += latencyBuckets[i][j];
+            text += "sbb_handler_duration_seconds_bucket{type=\"" + type + "\",le=\""
+                    + QString::number(latencyLimitsNs[j] / 1e9) + "\"} " + QString::number(cumulative) + '\n';
+        }
+        text += "sbb_handler_duration_seconds_bucket{type=\"" + type + "\",le=\"+Inf\"} " + QString::number(count) + '\n';
+        text += "sbb_handler_duration_seconds_sum{type=\"" + type + "\"} " + QString::number(latencySumNs[i] / 1e9, 'g', 12) + '\n';
+        text += "sbb_handler_duration_seconds_count{type=\"" + type + "\"} " + QString::number(count) + '\n';
+    }
+    return text;
+}
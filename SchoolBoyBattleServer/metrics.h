@@ -0,0 +1,73 @@
+/*
+ * Description : Cette classe compte les messages et octets reçus / envoyés
+ *               par type de message, et le temps de traitement des messages.
+ *               Chaque thread a ses propres compteurs, qu'il est le seul à
+ *               écrire (pas de verrou, pas d'instruction atomique coûteuse).
+ *               Les compteurs de tous les threads ne sont additionnés qu'au
+ *               moment de la lecture (render), au format texte Prometheus.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "protocol.h"
+
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+#define NB_LATENCY_BUCKETS 12
+#define NB_LOAD_LEVELS 4        // Room::NbLoadLevels
+
+class Metrics
+{
+public:
+    static void messageIn(int messageId, int bytes);
+    static void invalidMessageIn(int bytes);
+    static void messageOut(int messageId, int bytes);
+    static void messagesDropped(int messageId, int count);
+    static void messageRateLimited(int messageId);
+    static void socketWrite(int bytes);
+    static void handlerLatency(int messageId, qint64 nsecs);
+    static void idleDisconnect();
+    static void tickOverBudget();
+    static void roomOverload(int level);
+
+    static QString render();
+
+private:
+    typedef struct ThreadCounters_s {
+        std::atomic<quint64> messagesIn[Protocol::NbMessageIds];
+        std::atomic<quint64> bytesIn[Protocol::NbMessageIds];
+        std::atomic<quint64> messagesOut[Protocol::NbMessageIds];
+        std::atomic<quint64> bytesOut[Protocol::NbMessageIds];
+        std::atomic<quint64> messagesDropped[Protocol::NbMessageIds];
+        std::atomic<quint64> messagesRateLimited[Protocol::NbMessageIds];
+        std::atomic<quint64> socketWrites;
+        std::atomic<quint64> socketWriteBytes;
+        std::atomic<quint64> invalidMessages;
+        std::atomic<quint64> invalidBytes;
+        std::atomic<quint64> idleDisconnects;
+        std::atomic<quint64> ticksOverBudget;
+        std::atomic<quint64> roomOverloads[NB_LOAD_LEVELS];    // Passages d'une partie à ce niveau
+        // Le dernier bucket compte les traitements plus longs que toutes les limites
+        std::atomic<quint64> latencyBuckets[Protocol::NbMessageIds][NB_LATENCY_BUCKETS + 1];
+        std::atomic<quint64> latencySumNs[Protocol::NbMessageIds];
+    } ThreadCounters;
+
+    static ThreadCounters *local();
+    static inline void add(std::atomic<quint64> &counter, quint64 value) {
+        // Un seul thread écrit ce compteur : pas besoin de fetch_add
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    // Les compteurs des threads terminés sont gardés, ils ne doivent pas diminuer
+    static QMutex registryLock;
+    static QVector<ThreadCounters *> registry;
+};
+
+#endif // METRICS_H
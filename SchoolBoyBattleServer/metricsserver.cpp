@@ -0,0 +1,76 @@
+/*
+ * Description : Petit serveur HTTP local qui répond à GET /metrics avec les
+ *               métriques du serveur au format texte Prometheus. Il n'écoute
+ *               que sur localhost et ne sert qu'une requête par connexion.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "metricsserver.h"
+#include "logger.h"
+
+// Une requête plus grande est refusée
+#define MAX_REQUEST_SIZE 8192
+
+MetricsServer::MetricsServer(TcpServer *gameServer, QObject *parent) :
+    QTcpServer(parent),
+    gameServer(gameServer)
+{
+    connect(this, &QTcpServer::newConnection, this, &MetricsServer::onNewConnection);
+}
+
+bool MetricsServer::start(quint16 port)
+{
+    if(!listen(QHostAddress::LocalHost, port)) {
+        Logger::log(Logger::Error, "Impossible de démarrer les métriques : " + errorString());
+        return false;
+    }
+    Logger::log(Logger::Info, "Métriques sur http://127.0.0.1:" + QString::number(serverPort()) + "/metrics");
+    return true;
+}
+
+void MetricsServer::onNewConnection()
+{
+    while(hasPendingConnections()) {
+        QTcpSocket *socket = nextPendingConnection();
+        connect(socket, &QTcpSocket::readyRead, this, std::bind(&MetricsServer::readRequest, this, socket));
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+/*
+ * On attend d'avoir tous les en-têtes, seule la première ligne est utilisée
+ */
+void MetricsServer::readRequest(QTcpSocket *socket)
+{
+    const QByteArray request = socket->peek(MAX_REQUEST_SIZE);
+    if(!request.contains("\r\n\r\n")) {
+        if(request.size() >= MAX_REQUEST_SIZE)
+            socket->abort();
+        return;
+    }
+    socket->readAll();
+
+    const QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+    if(requestLine.size() < 2 || requestLine.at(0) != "GET") {
+        sendResponse(socket, "405 Method Not Allowed", QByteArray());
+        return;
+    }
+    if(requestLine.at(1) != "/metrics") {
+        sendResponse(socket, "404 Not Found", QByteArray());
+        return;
+    }
+    sendResponse(socket, "200 OK", gameServer->renderMetrics().toUtf8());
+}
+
+void MetricsServer::sendResponse(QTcpSocket *socket, const QByteArray &status, const QByteArray &body)
+{
+    QByteArray response = "HTTP/1.0 " + status + "\r\n"
+            "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+            "Connection: close\r\n\r\n";
+    response += body;
+    socket->write(response);
+    socket->disconnectFromHost();
+}
@@ -0,0 +1,38 @@
+/*
+ * Description : Petit serveur HTTP local qui répond à GET /metrics avec les
+ *               métriques du serveur au format texte Prometheus. Il n'écoute
+ *               que sur localhost et ne sert qu'une requête par connexion.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include "tcpserver.h"
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+class MetricsServer : public QTcpServer
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(MetricsServer)
+
+public:
+    MetricsServer(TcpServer *gameServer, QObject *parent = nullptr);
+    bool start(quint16 port);
+
+private:
+    TcpServer *gameServer;
+
+    void readRequest(QTcpSocket *socket);
+    static void sendResponse(QTcpSocket *socket, const QByteArray &status, const QByteArray &body);
+
+private slots:
+    void onNewConnection();
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,138 @@
+/*
+ * Description : Cette classe écrit les enregistrements des parties sur le
+ *               disque, dans un thread de fond partagé par toutes les
+ *               parties. Les parties ne font que lui confier des blocs déjà
+ *               sérialisés : le thread d'une partie n'attend jamais le disque.
+ *               Si le disque ne suit pas, les blocs en trop sont perdus.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "recordwriter.h"
+#include "logger.h"
+#include <QDir>
+#include <QMutexLocker>
+
+// Au-delà, le disque ne suit pas et les nouveaux blocs sont perdus
+#define MAX_PENDING_BYTES (64 * 1024 * 1024)
+
+RecordWriter::RecordWriter(const QString &directory, QObject *parent) :
+    QThread(parent),
+    directory(directory),
+    running(true),
+    nextFileId(0),
+    pendingBytes(0)
+{
+    QDir().mkpath(directory);
+}
+
+RecordWriter::~RecordWriter()
+{
+    stop();
+}
+
+/*
+ * Le fichier est créé par le thread de fond, on retourne tout de suite son id
+ */
+int RecordWriter::open(const QString &fileName)
+{
+    Job job;
+    job.fileId = nextFileId.fetch_add(1, std::memory_order_relaxed);
+    job.fileName = QDir(directory).filePath(fileName);
+    job.close = false;
+    push(job);
+    return job.fileId;
+}
+
+/*
+ * Retourne false si le bloc a été perdu parce que le disque ne suit pas
+ */
+bool RecordWriter::append(int fileId, const QByteArray &data)
+{
+    if(pendingBytes.load(std::memory_order_relaxed) + data.size() > MAX_PENDING_BYTES)
+        return false;
+    pendingBytes.fetch_add(data.size(), std::memory_order_relaxed);
+    Job job;
+    job.fileId = fileId;
+    job.data = data;
+    job.close = false;
+    push(job);
+    return true;
+}
+
+void RecordWriter::close(int fileId)
+{
+    Job job;
+    job.fileId = fileId;
+    job.close = true;
+    push(job);
+}
+
+void RecordWriter::push(const Job &job)
+{
+    QMutexLocker locker(&jobsLock);
+    jobs.append(job);
+    jobsAvailable.wakeOne();
+}
+
+/*
+ * Arrête le thread de fond après avoir écrit et fermé tous les fichiers
+ */
+void RecordWriter::stop()
+{
+    if(!isRunning())
+        return;
+    jobsLock.lock();
+    running = false;
+    jobsAvailable.wakeOne();
+    jobsLock.unlock();
+    wait();
+}
+
+void RecordWriter::run()
+{
+    while(true) {
+        jobsLock.lock();
+        while(jobs.isEmpty() && running)
+            jobsAvailable.wait(&jobsLock);
+        const QList<Job> batch = jobs;
+        jobs.clear();
+        const bool stopping = !running;
+        jobsLock.unlock();
+
+        // Le disque n'est touché qu'ici, sans tenir le verrou
+        for(int i = 0; i < batch.size(); i++)
+            process(batch.at(i));
+        if(stopping && batch.isEmpty())
+            break;
+    }
+
+    // Fichiers pas fermés par leur partie
+    qDeleteAll(files);
+    files.clear();
+}
+
+void RecordWriter::process(const Job &job)
+{
+    if(!job.fileName.isEmpty()) {
+        QFile *file = new QFile(job.fileName);
+        if(!file->open(QIODevice::WriteOnly | QIODevice::Append)) {
+            Logger::log(Logger::Error, "Impossible d'ouvrir l'enregistrement " + job.fileName);
+            delete file;
+            return;
+        }
+        files.insert(job.fileId, file);
+        Logger::log(Logger::Info, "Enregistrement de la partie dans " + job.fileName);
+        return;
+    }
+
+    QFile *file = files.value(job.fileId);
+    if(job.close) {
+        delete files.take(job.fileId);
+        return;
+    }
+    pendingBytes.fetch_sub(job.data.size(), std::memory_order_relaxed);
+    if(file != nullptr)
+        file->write(job.data);
+}
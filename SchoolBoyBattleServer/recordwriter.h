@@ -0,0 +1,64 @@
+/*
+ * Description : Cette classe écrit les enregistrements des parties sur le
+ *               disque, dans un thread de fond partagé par toutes les
+ *               parties. Les parties ne font que lui confier des blocs déjà
+ *               sérialisés : le thread d'une partie n'attend jamais le disque.
+ *               Si le disque ne suit pas, les blocs en trop sont perdus.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef RECORDWRITER_H
+#define RECORDWRITER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+
+class RecordWriter : public QThread
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(RecordWriter)
+
+public:
+    RecordWriter(const QString &directory, QObject *parent = nullptr);
+    ~RecordWriter();
+
+    // Utilisables depuis n'importe quel thread
+    int open(const QString &fileName);
+    bool append(int fileId, const QByteArray &data);
+    void close(int fileId);
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    typedef struct Job_s {
+        int fileId;
+        QString fileName;       // Seulement pour ouvrir le fichier
+        QByteArray data;
+        bool close;
+    } Job;
+
+    const QString directory;
+    QMutex jobsLock;
+    QWaitCondition jobsAvailable;
+    QList<Job> jobs;
+    bool running;               // Protégé par jobsLock
+    std::atomic<int> nextFileId;
+    std::atomic<qint64> pendingBytes;
+    QHash<int, QFile *> files;  // Uniquement dans le thread de fond
+
+    void push(const Job &job);
+    void process(const Job &job);
+};
+
+#endif // RECORDWRITER_H
@@ -0,0 +1,738 @@
+/*
+ * Description : Cette classe représente une partie hébergée par le serveur.
+ *               Elle possède ses clients, ses candies et son état
+ *               (salle d'attente puis partie en cours). Le TcpServer place
+ *               chaque client dans une partie au moment du login, ce qui
+ *               permet d'héberger plusieurs parties en même temps.
+ *               Une partie vit dans un seul thread, avec les sockets de tous
+ *               ses clients : traitement des messages et envois se font sans
+ *               passer d'un thread à l'autre.
+ *               Pendant le jeu, elle fait avancer sa Simulation à pas fixe
+ *               et envoie à chaque client l'état des joueurs proches de lui.
+ *               Elle décide seule de la durée de la partie : le temps
+ *               restant et les scores sont envoyés aux clients, jusqu'aux
+ *               scores finaux.
+ *               Des bots peuvent occuper des places : ils jouent dans le
+ *               pas de la partie, sans socket.
+ *               La liste des joueurs est versionnée : un client reçoit la
+ *               liste complète en arrivant, puis seulement les changements.
+ *               Chaque pas est mesuré (simulation et envois) par rapport à
+ *               un budget. Une partie qui le dépasse se déleste par
+ *               niveaux : moins de joueurs lointains, puis moins de
+ *               snapshots, puis plus de nouvelle partie dans son thread.
+ *               Si le serveur enregistre les parties, tout ce qui entre et
+ *               sort pendant le jeu est confié à un MatchRecorder.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "room.h"
+#include "metrics.h"
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QThread>
+
+#define MAX_ROOM_USERS 8
+#define TICK_NS (1000000000LL / TICK_RATE)
+#define MAX_CATCHUP_TICKS 5         // Au-delà, le retard est abandonné
+#define SNAPSHOT_COALESCE_KEY 0     // Un snapshot remplace le précédent pas encore envoyé
+#define FAR_SNAPSHOT_TICKS 10       // Les joueurs hors de la vue ne sont envoyés que 3 fois par seconde
+#define MATCH_DURATION_TICKS (3 * 60 * TICK_RATE)
+#define MATCH_CLOCK_TICKS TICK_RATE // Le temps restant est envoyé chaque seconde
+#define FIRST_BOT_DESCRIPTOR -100   // Les bots ont des descriptors négatifs, -1 est réservé
+// Plusieurs parties partagent un thread : chacune n'a droit qu'à une part du pas
+#define TICK_BUDGET_NS (TICK_NS / 8)
+// Un timer en retard de plus d'un demi-pas : le thread a trop de travail
+#define TICK_LATE_NS (TICK_NS / 2)
+#define LOAD_WINDOW_TICKS TICK_RATE
+// Plus d'un pas sur quatre hors budget dans la fenêtre : un niveau de plus.
+// Il faut 3 fenêtres sans dépassement pour redescendre d'un niveau.
+#define OVERLOAD_RATIO 4
+#define RECOVERY_WINDOWS 3
+#define SHED_FAR_SNAPSHOT_TICKS TICK_RATE
+#define SHED_SNAPSHOT_TICKS 2
+
+Q_STATIC_ASSERT(Room::NbLoadLevels == NB_LOAD_LEVELS);
+
+Room::Room(int id, int capacity, const GameMap *map, RecordWriter *recordWriter, QObject *parent) :
+    QObject(parent),
+    id(id),
+    capacity(qBound(1, capacity, MAX_ROOM_USERS)),
+    gameStarted(false),
+    nbReservedSeats(0),
+    nbBots(0),
+    map(map),
+    tickLagNs(0),
+    loadLevel(LoadNormal),
+    tickCostNs(0),
+    windowTicks(0),
+    windowOverBudget(0),
+    windowCostNs(0),
+    cleanWindows(0),
+    recordWriter(recordWriter),
+    recorder(nullptr),
+    lobbyVersion(0)
+{
+    clients.reserve(MAX_ROOM_USERS);
+    registerHandlers();
+
+    // Enfants de la partie : ils changent de thread avec elle
+    simulation = new Simulation(map, this);
+    connect(simulation, &Simulation::candySpawned, this, &Room::candySpawned);
+    connect(simulation, &Simulation::candyTaken, this, &Room::candyTaken);
+    connect(simulation, &Simulation::candiesStolen, this, &Room::candiesStolen);
+    connect(simulation, &Simulation::candiesValidated, this, &Room::candiesValidated);
+    tickTimer = new QTimer(this);
+    tickTimer->setTimerType(Qt::PreciseTimer);
+    tickTimer->setInterval(1000 / TICK_RATE);
+    connect(tickTimer, &QTimer::timeout, this, &Room::tick);
+}
+
+Room::~Room()
+{
+    stopRecording();
+}
+
+/*
+ * Chaque type de message a son traitement, enregistré une seule fois
+ */
+void Room::registerHandlers()
+{
+    using namespace std::placeholders;
+    // Les candies sont gérés par la simulation, les clients envoient leurs touches
+    // et les contacts qu'ils ont vus
+    dispatcher.registerHandler(Protocol::PlayerMove, std::bind(&Room::playerMove, this, _1, _2));
+    dispatcher.registerHandler(Protocol::ClaimCandy, std::bind(&Room::claimCandy, this, _1, _2));
+    dispatcher.registerHandler(Protocol::SnapshotAck, std::bind(&Room::snapshotAck, this, _1, _2));
+    dispatcher.registerHandler(Protocol::ToggleReady, std::bind(&Room::toggleReady, this, _1, _2));
+    dispatcher.registerHandler(Protocol::UpdateUsersList, std::bind(&Room::updateUsersList, this, _1, _2));
+}
+
+int Room::getId() const {
+    return id;
+}
+
+int Room::getCapacity() const {
+    return capacity;
+}
+
+bool Room::isStarted() const {
+    return gameStarted.load(std::memory_order_acquire);
+}
+
+int Room::getLoadLevel() const {
+    return loadLevel.load(std::memory_order_relaxed);
+}
+
+qint64 Room::getTickCostNs() const {
+    return tickCostNs.load(std::memory_order_relaxed);
+}
+
+/*
+ * On ne peut rejoindre qu'une partie en salle d'attente et pas pleine
+ */
+bool Room::isJoinable() const {
+    return !isStarted() && usernames.length() + nbBots.load(std::memory_order_relaxed) < capacity;
+}
+
+bool Room::isEmpty() const {
+    return usernames.isEmpty();
+}
+
+int Room::getNbSeats() const {
+    return usernames.length() + nbBots.load(std::memory_order_relaxed);
+}
+
+bool Room::hasUsername(const QString &username) const {
+    return usernames.contains(username, Qt::CaseInsensitive);
+}
+
+/*
+ * La place est réservée par le TcpServer au login, avant que le client
+ * n'arrive dans le thread de la partie
+ */
+void Room::reserveSeat(const QString &username) {
+    usernames.append(username);
+    nbReservedSeats.store(usernames.length(), std::memory_order_relaxed);
+}
+
+void Room::releaseSeat(const QString &username) {
+    usernames.removeOne(username);
+    nbReservedSeats.store(usernames.length(), std::memory_order_relaxed);
+}
+
+/*
+ * Le client a déjà son username, on lui confirme le login et on lui envoie
+ * la liste complète des joueurs. Les autres ne reçoivent que le nouveau.
+ */
+void Room::addClient(ServerWorker *client) {
+    Q_ASSERT(client->thread() == thread());
+    // Le client s'est déconnecté pendant son déplacement vers ce thread
+    if(!client->isConnected()) {
+        emit clientLeft(client);
+        return;
+    }
+    // La partie a commencé pendant son déplacement vers ce thread
+    if(isStarted()) {
+        QJsonObject failureMessage;
+        failureMessage[QStringLiteral("success")] = false;
+        failureMessage[QStringLiteral("reason")] = QStringLiteral("gameAlreadyStarted");
+        sendJson(client, Protocol::Login, failureMessage);
+        // Le refus doit partir avant la fermeture du socket
+        client->flush();
+        // removeClient libère sa place une fois la déconnexion terminée
+        rejectedClients.append(client);
+        client->disconnectFromClient();
+        Logger::log(Logger::Info, client->getUsername() + " refusé, la partie " + QString::number(id) + " a déjà commencé");
+        return;
+    }
+    client->setReady(false);
+    clients.append(client);
+
+    QJsonObject successMessage;
+    successMessage[QStringLiteral("success")] = true;
+    successMessage[QStringLiteral("descriptor")] = client->getSocketDescriptor();
+    sendJson(client, Protocol::Login, successMessage);
+
+    QJsonObject joined;
+    joined.insert(QString::number(client->getSocketDescriptor()), lobbyUser(client));
+    QJsonObject diff;
+    diff.insert("joined", joined);
+    sendLobbyDiff(diff, client);
+    sendUserList(client);
+    Logger::log(Logger::Info, client->getUsername() + " a rejoint la partie " + QString::number(id));
+}
+
+/*
+ * Le bot prend une place libre et est toujours prêt. Retourne false si la
+ * partie est pleine. Les places réservées comptent aussi les clients
+ * encore en route vers ce thread.
+ */
+bool Room::addBot() {
+    if(nbReservedSeats.load(std::memory_order_relaxed) + bots.length() >= capacity)
+        return false;
+    bots.append(Bot(FIRST_BOT_DESCRIPTOR - bots.length(), "Bot " + QString::number(bots.length() + 1)));
+    nbBots.store(bots.length(), std::memory_order_relaxed);
+    if(!clients.isEmpty() && !isStarted()) {
+        QJsonObject joined;
+        joined.insert(QString::number(bots.last().getDescriptor()), lobbyUser(bots.last()));
+        QJsonObject diff;
+        diff.insert("joined", joined);
+        sendLobbyDiff(diff);
+    }
+    return true;
+}
+
+/*
+ * Le TcpServer est prévenu avec clientLeft, c'est lui qui libère la place
+ * et supprime le client
+ */
+void Room::removeClient(ServerWorker *client) {
+    if(rejectedClients.removeOne(client)) {
+        emit clientLeft(client);
+        return;
+    }
+    // Pas encore arrivé dans la partie, addClient s'en occupera
+    if(!clients.removeOne(client))
+        return;
+    Logger::log(Logger::Info, client->getUsername() + QLatin1String(" disconnected"));
+    simulation->removePlayer(client->getSocketDescriptor());
+    snapshotEncoders.remove(client->getSocketDescriptor());
+    if(clients.isEmpty()) {
+        tickTimer->stop();
+        setLoadLevel(LoadNormal);
+        tickCostNs.store(0, std::memory_order_relaxed);
+        stopRecording();
+        Logger::log(Logger::Info, "Tous les clients de la partie " + QString::number(id) + " sont déconnectés");
+    } else {
+        QJsonObject diff;
+        diff.insert("left", QJsonArray({QString::number(client->getSocketDescriptor())}));
+        sendLobbyDiff(diff);
+    }
+    emit clientLeft(client);
+}
+
+void Room::messageReceived(ServerWorker *sender, int messageId, const QJsonObject &doc) {
+    if(recorder)
+        recorder->inbound(sender->getSocketDescriptor(), messageId, doc);
+    QElapsedTimer handlerTimer;
+    handlerTimer.start();
+    if(!dispatcher.dispatch(messageId, sender, doc)) {
+        // Le client peut en envoyer autant qu'il veut : rien n'est formaté sans le niveau Debug
+        if(Logger::isEnabled(Logger::Debug))
+            Logger::log(Logger::Debug, "Message " + Protocol::name(messageId) + " ignoré de " + QString::number(sender->getSocketDescriptor()));
+        return;
+    }
+    Metrics::handlerLatency(messageId, handlerTimer.nsecsElapsed());
+}
+
+/*
+ * Sérialise le message une seule fois, id et préfixe de taille compris.
+ * Le résultat peut être envoyé tel quel à plusieurs clients.
+ */
+QByteArray Room::encode(Protocol::MessageId messageId, const QJsonObject &message, qintptr destinationDescriptor)
+{
+    const QByteArray payload = Protocol::encode(messageId, message);
+    // Le test du niveau évite tout formatage quand les paquets ne sont pas loggés
+    if(Logger::isEnabled(Logger::Debug) && Logger::isSampled(messageId))
+        Logger::logPacket(Logger::Debug, Logger::PacketOut, destinationDescriptor, payload);
+    return Protocol::frame(payload);
+}
+
+void Room::sendJson(ServerWorker *destination, Protocol::MessageId messageId, const QJsonObject &message)
+{
+    Q_ASSERT(destination);
+    sendPacket(destination, encode(messageId, message, destination->getSocketDescriptor()), messageId);
+}
+
+/*
+ * coalesceKey est le joueur concerné par le message, il permet au worker
+ * de remplacer un ancien état de ce joueur qui n'a pas encore été envoyé
+ */
+void Room::sendPacket(ServerWorker *destination, const QByteArray &packet, Protocol::MessageId messageId, qintptr coalesceKey)
+{
+    Q_ASSERT(destination);
+    // Le client est dans le thread de la partie, on écrit directement
+    Q_ASSERT(destination->thread() == QThread::currentThread());
+    if(recorder)
+        recorder->outbound(destination->getSocketDescriptor(), packet);
+    destination->sendPacket(packet, messageId, coalesceKey);
+}
+
+/*
+ * Enregistré une seule fois, avec le descriptor -1
+ */
+void Room::sendEveryone(Protocol::MessageId messageId, const QJsonObject &message, qintptr coalesceKey) {
+    const QByteArray packet = encode(messageId, message);
+    if(recorder)
+        recorder->outbound(-1, packet);
+    for(int i = 0; i < clients.length(); i++) {
+        Q_ASSERT(clients.at(i));
+        Q_ASSERT(clients.at(i)->thread() == QThread::currentThread());
+        clients.at(i)->sendPacket(packet, messageId, coalesceKey);
+    }
+}
+
+QJsonObject Room::lobbyUser(const ServerWorker *client) {
+    QJsonObject userProps;
+    userProps.insert("username", client->getUsername());
+    userProps.insert("ready", client->getReady());
+    userProps.insert("gender", client->getGender());
+    userProps.insert("team", client->getTeam());
+    return userProps;
+}
+
+QJsonObject Room::lobbyUser(const Bot &bot) {
+    QJsonObject botProps;
+    botProps.insert("username", bot.getUsername());
+    botProps.insert("ready", true);
+    botProps.insert("gender", bot.getGender());
+    botProps.insert("team", bot.getTeam());
+    botProps.insert("bot", true);
+    return botProps;
+}
+
+QJsonObject Room::generateUserList() {
+    QJsonObject clientsHash;
+    for(int i = 0; i < clients.length(); i++)
+        clientsHash.insert(QString::number(clients.at(i)->getSocketDescriptor()), lobbyUser(clients.at(i)));
+    for(int i = 0; i < bots.length(); i++)
+        clientsHash.insert(QString::number(bots.at(i).getDescriptor()), lobbyUser(bots.at(i)));
+    return clientsHash;
+}
+
+/*
+ * Liste complète, seulement pour un client qui arrive ou qui a perdu le fil
+ */
+void Room::sendUserList(ServerWorker *destination) {
+    QJsonObject userListMessage;
+    userListMessage.insert("version", qint64(lobbyVersion));
+    userListMessage.insert("users", QJsonValue(generateUserList()));
+    sendJson(destination, Protocol::UpdateUsersList, userListMessage);
+}
+
+/*
+ * Un changement de la liste : "joined" (descriptor -> joueur), "left"
+ * (descriptors) ou "changed" (descriptor -> champs modifiés). Le client
+ * l'applique sur la version précédente.
+ */
+void Room::sendLobbyDiff(QJsonObject diff, ServerWorker *except) {
+    lobbyVersion++;
+    diff.insert("version", qint64(lobbyVersion));
+    const QByteArray packet = encode(Protocol::LobbyDiff, diff);
+    if(recorder)
+        recorder->outbound(-1, packet);
+    for(int i = 0; i < clients.length(); i++) {
+        if(clients.at(i) != except)
+            clients.at(i)->sendPacket(packet, Protocol::LobbyDiff);
+    }
+}
+
+void Room::checkEveryoneReady() {
+    for(int i = 0; i < clients.length(); i++) {
+        if(!clients.at(i)->getReady())
+            return;
+    }
+    startGame();
+}
+
+void Room::startGame() {
+    // Un bot de plus pour des équipes égales, ou pour ne pas jouer seul
+    if((clients.length() + bots.length()) % 2 == 1)
+        addBot();
+
+    // Générer la team et le gender de chaque client
+    // On shuffle le vecteur des clients
+    std::random_shuffle(clients.begin(), clients.end());
+    bool teamSetter = 0;
+    for(int i = 0; i < clients.length(); i++) {
+        clients.at(i)->setTeam(teamSetter);
+        teamSetter = !teamSetter;
+        clients.at(i)->setGender(rand()%2);
+    }
+    // Les bots complètent les équipes
+    for(int i = 0; i < bots.length(); i++) {
+        bots[i].setTeam(teamSetter);
+        teamSetter = !teamSetter;
+        bots[i].setGender(rand()%2);
+    }
+    // L'enregistrement commence avant les premiers messages de la partie
+    stopRecording();
+    if(recordWriter)
+        recorder = new MatchRecorder(recordWriter, id);
+
+    // Les joueurs partent de la base de leur équipe, sans aucun candy
+    simulation->reset();
+    snapshotEncoders.clear();
+    for(int i = 0; i < clients.length(); i++) {
+        simulation->addPlayer(clients.at(i)->getSocketDescriptor(), clients.at(i)->getTeam());
+        snapshotEncoders.insert(clients.at(i)->getSocketDescriptor(), SnapshotEncoder());
+    }
+    for(int i = 0; i < bots.length(); i++) {
+        bots[i].reset();
+        simulation->addPlayer(bots.at(i).getDescriptor(), bots.at(i).getTeam());
+    }
+
+    // Envoyer à tout le monde les teams / genders tirés
+    QJsonObject changed;
+    for(int i = 0; i < clients.length(); i++) {
+        QJsonObject userProps;
+        userProps.insert("team", clients.at(i)->getTeam());
+        userProps.insert("gender", clients.at(i)->getGender());
+        changed.insert(QString::number(clients.at(i)->getSocketDescriptor()), userProps);
+    }
+    for(int i = 0; i < bots.length(); i++) {
+        QJsonObject botProps;
+        botProps.insert("team", bots.at(i).getTeam());
+        botProps.insert("gender", bots.at(i).getGender());
+        changed.insert(QString::number(bots.at(i).getDescriptor()), botProps);
+    }
+    QJsonObject diff;
+    diff.insert("changed", changed);
+    sendLobbyDiff(diff);
+
+    QJsonObject startGameMessage;
+    startGameMessage.insert("nbUsers", QJsonValue(clients.length() + bots.length()));
+    sendEveryone(Protocol::StartGame, startGameMessage);
+    sendMatchClock();
+
+    // Les paquets ne partent plus qu'à la fin de chaque pas
+    for(int i = 0; i < clients.length(); i++)
+        clients.at(i)->setTickAligned(true);
+
+    gameStarted.store(true, std::memory_order_release);
+    tickLagNs = 0;
+    setLoadLevel(LoadNormal);
+    tickCostNs.store(0, std::memory_order_relaxed);
+    windowTicks = 0;
+    windowOverBudget = 0;
+    windowCostNs = 0;
+    cleanWindows = 0;
+    tickClock.start();
+    tickTimer->start();
+    Logger::log(Logger::Info, "Partie " + QString::number(id) + " démarrée avec " + QString::number(clients.length()) + " joueurs et "
+                + QString::number(bots.length()) + " bots");
+}
+
+/*
+ * Le timer n'est pas exact : on rattrape les pas en retard pour que la
+ * simulation avance toujours de TICK_RATE pas par seconde, puis on envoie
+ * un seul snapshot avec le dernier état.
+ * Chaque client reçoit les joueurs qui sont dans sa vue à chaque pas, et
+ * tous les autres seulement tous les FAR_SNAPSHOT_TICKS pas.
+ * Le snapshot ne contient que ce qui a changé depuis le dernier snapshot
+ * confirmé par le client.
+ * Tout ce qui a été envoyé depuis le pas précédent part en un seul batch.
+ * Le temps restant part chaque seconde, et la partie s'arrête d'elle-même
+ * après MATCH_DURATION_TICKS pas.
+ * Une partie délestée espace ses snapshots, les événements partent
+ * toujours à chaque pas.
+ */
+void Room::tick() {
+    QElapsedTimer costTimer;
+    costTimer.start();
+    const qint64 sinceLastTickNs = tickClock.nsecsElapsed();
+    tickLagNs += sinceLastTickNs;
+    tickClock.restart();
+    int nbTicks = 0;
+    while(tickLagNs >= TICK_NS && nbTicks < MAX_CATCHUP_TICKS && simulation->getTick() < MATCH_DURATION_TICKS) {
+        // Les bots donnent leurs touches comme les clients, juste avant le pas
+        for(int i = 0; i < bots.length(); i++)
+            bots[i].step(simulation);
+        simulation->step();
+        if(recorder)
+            recorder->tick(simulation->getTick());
+        tickLagNs -= TICK_NS;
+        nbTicks++;
+    }
+    if(nbTicks == MAX_CATCHUP_TICKS)
+        tickLagNs = 0;
+    if(nbTicks == 0) {
+        for(int i = 0; i < clients.length(); i++)
+            clients.at(i)->flush();
+        if(recorder)
+            recorder->flush();
+        return;
+    }
+    const int level = loadLevel.load(std::memory_order_relaxed);
+    const quint32 farSnapshotTicks = level >= LoadFewerFarPlayers ? SHED_FAR_SNAPSHOT_TICKS : FAR_SNAPSHOT_TICKS;
+    const bool withFarPlayers = simulation->getTick() % farSnapshotTicks < quint32(nbTicks);
+    const bool withSnapshots = level < LoadFewerSnapshots || simulation->getTick() % SHED_SNAPSHOT_TICKS < quint32(nbTicks);
+    if(simulation->getTick() % MATCH_CLOCK_TICKS < quint32(nbTicks))
+        sendMatchClock();
+    for(int i = 0; i < clients.length(); i++) {
+        if(withSnapshots) {
+            const qintptr descriptor = clients.at(i)->getSocketDescriptor();
+            const QJsonObject snapshot = snapshotEncoders[descriptor].encode(
+                        simulation->getTick(), simulation->visiblePlayers(descriptor, withFarPlayers));
+            sendPacket(clients.at(i), encode(Protocol::Snapshot, snapshot, descriptor), Protocol::Snapshot, SNAPSHOT_COALESCE_KEY);
+        }
+        clients.at(i)->flush();
+    }
+    // Le disque n'est touché que par le thread du RecordWriter
+    if(recorder)
+        recorder->flush();
+    accountTick(costTimer.nsecsElapsed(), sinceLastTickNs - qint64(nbTicks) * TICK_NS);
+    if(simulation->getTick() >= MATCH_DURATION_TICKS)
+        endMatch();
+}
+
+/*
+ * Un pas est hors budget s'il a coûté trop cher à la partie, ou si le
+ * timer est arrivé trop tard parce que le thread est surchargé. Le niveau
+ * de délestage est revu à la fin de chaque fenêtre : il monte d'un cran
+ * par fenêtre chargée et ne redescend qu'après RECOVERY_WINDOWS fenêtres
+ * sans dépassement, pour ne pas osciller.
+ */
+void Room::accountTick(qint64 costNs, qint64 lateNs)
+{
+    const bool overBudget = costNs > TICK_BUDGET_NS || lateNs > TICK_LATE_NS;
+    windowTicks++;
+    windowCostNs += costNs;
+    if(overBudget) {
+        windowOverBudget++;
+        Metrics::tickOverBudget();
+    }
+    if(windowTicks < LOAD_WINDOW_TICKS)
+        return;
+
+    tickCostNs.store(windowCostNs / windowTicks, std::memory_order_relaxed);
+    const int level = loadLevel.load(std::memory_order_relaxed);
+    if(windowOverBudget * OVERLOAD_RATIO > windowTicks) {
+        cleanWindows = 0;
+        if(level < LoadSaturated)
+            setLoadLevel(level + 1);
+    } else if(windowOverBudget == 0 && level > LoadNormal && ++cleanWindows >= RECOVERY_WINDOWS) {
+        cleanWindows = 0;
+        setLoadLevel(level - 1);
+    }
+    windowTicks = 0;
+    windowOverBudget = 0;
+    windowCostNs = 0;
+}
+
+void Room::setLoadLevel(int level)
+{
+    const int previous = loadLevel.exchange(level, std::memory_order_relaxed);
+    if(level == previous)
+        return;
+    if(level > previous) {
+        Metrics::roomOverload(level);
+        Logger::log(Logger::Warning, "Partie " + QString::number(id) + " hors budget, délestage niveau " + QString::number(level)
+                    + " (pas moyen : " + QString::number(tickCostNs.load(std::memory_order_relaxed) / 1000) + " us)");
+    } else
+        Logger::log(Logger::Info, "Partie " + QString::number(id) + " revenue au niveau de délestage " + QString::number(level));
+}
+
+/*
+ * Temps restant en secondes et points validés de chaque équipe. Les
+ * clients n'ont pas d'horloge à eux, ils affichent ces valeurs.
+ */
+void Room::sendMatchClock()
+{
+    const quint32 ticksLeft = MATCH_DURATION_TICKS - qMin<quint32>(simulation->getTick(), MATCH_DURATION_TICKS);
+    QJsonObject matchClock;
+    matchClock.insert("remaining", QJsonValue(int((ticksLeft + TICK_RATE - 1) / TICK_RATE)));
+    matchClock.insert("scores", QJsonArray({simulation->getScore(0), simulation->getScore(1)}));
+    sendEveryone(Protocol::MatchClock, matchClock);
+}
+
+/*
+ * Le temps est écoulé : les scores finaux sont les mêmes pour tout le
+ * monde. La partie ne peut plus être rejointe, elle sera fermée quand le
+ * dernier client sera parti.
+ */
+void Room::endMatch()
+{
+    tickTimer->stop();
+    const int scoreRed = simulation->getScore(0);
+    const int scoreBlack = simulation->getScore(1);
+    QJsonObject matchEnd;
+    matchEnd.insert("scores", QJsonArray({scoreRed, scoreBlack}));
+    matchEnd.insert("winner", QJsonValue(scoreRed > scoreBlack ? 0 : scoreRed < scoreBlack ? 1 : -1));
+    sendEveryone(Protocol::MatchEnd, matchEnd);
+    // Plus de pas : les paquets suivants partent tout de suite
+    for(int i = 0; i < clients.length(); i++)
+        clients.at(i)->setTickAligned(false);
+    // Une partie terminée ne coûte plus rien à son thread
+    setLoadLevel(LoadNormal);
+    tickCostNs.store(0, std::memory_order_relaxed);
+    stopRecording();
+    Logger::log(Logger::Info, "Partie " + QString::number(id) + " terminée, " + QString::number(scoreRed)
+                + " à " + QString::number(scoreBlack));
+}
+
+/*
+ * Termine le fichier de la partie en cours, s'il y en a un
+ */
+void Room::stopRecording()
+{
+    if(!recorder)
+        return;
+    recorder->close();
+    delete recorder;
+    recorder = nullptr;
+}
+
+// TRAITEMENTS DES MESSAGES DES CLIENTS ----------------------------------------------------
+
+void Room::toggleReady(ServerWorker *sender, const QJsonObject &docObj)
+{
+    Q_UNUSED(docObj)
+    // Seulement en salle d'attente : startGame effacerait la partie en cours
+    if(isStarted())
+        return;
+    sender->setReady(!sender->getReady());
+    QJsonObject userProps;
+    userProps.insert("ready", sender->getReady());
+    QJsonObject changed;
+    changed.insert(QString::number(sender->getSocketDescriptor()), userProps);
+    QJsonObject diff;
+    diff.insert("changed", changed);
+    sendLobbyDiff(diff);
+    checkEveryoneReady();
+}
+
+/*
+ * Le client a reçu un changement qui ne suit pas sa version : il redemande
+ * la liste complète
+ */
+void Room::updateUsersList(ServerWorker *sender, const QJsonObject &docObj)
+{
+    Q_UNUSED(docObj)
+    sendUserList(sender);
+}
+
+/*
+ * Touche d'un joueur : la simulation la prend en compte au prochain pas, et
+ * on l'envoie aux autres clients qui voient ce joueur pour leurs animations.
+ * Les autres recevront ses touches avec le prochain snapshot complet.
+ */
+void Room::playerMove(ServerWorker *sender, const QJsonObject &docObj)
+{
+    const int direction = docObj.value(QLatin1String("direction")).toInt(-1);
+    const bool value = docObj.value(QLatin1String("value")).toBool();
+    simulation->setInput(sender->getSocketDescriptor(), direction, value);
+
+    QJsonObject userMove;
+    userMove.insert("direction", QJsonValue(direction));
+    userMove.insert("playerDescriptor", QJsonValue(sender->getSocketDescriptor()));
+    userMove.insert("value", QJsonValue(value));
+    QByteArray packet;
+    for(int i = 0; i < clients.length(); i++) {
+        if(clients.at(i) == sender || !simulation->isOfInterest(clients.at(i)->getSocketDescriptor(), sender->getSocketDescriptor()))
+            continue;
+        if(packet.isEmpty())
+            packet = encode(Protocol::PlayerMove, userMove);
+        sendPacket(clients.at(i), packet, Protocol::PlayerMove, sender->getSocketDescriptor());
+    }
+}
+
+/*
+ * Le client a vu son joueur toucher un candy (libre ou d'un adversaire).
+ * La simulation juge le contact au pas que le client voyait, et annonce
+ * elle-même le ramassage ou le vol s'il est accepté.
+ */
+void Room::claimCandy(ServerWorker *sender, const QJsonObject &docObj)
+{
+    if(!gameStarted.load(std::memory_order_relaxed))
+        return;
+    simulation->claimCandy(sender->getSocketDescriptor(),
+                           docObj.value(QLatin1String("candyId")).toInt(-1),
+                           quint32(docObj.value(QLatin1String("generation")).toDouble()),
+                           quint32(docObj.value(QLatin1String("tick")).toDouble()));
+}
+
+/*
+ * Les prochains snapshots du client seront encodés par rapport à celui-ci
+ */
+void Room::snapshotAck(ServerWorker *sender, const QJsonObject &docObj)
+{
+    if(!snapshotEncoders.contains(sender->getSocketDescriptor()))
+        return;
+    snapshotEncoders[sender->getSocketDescriptor()].acknowledge(quint32(docObj.value(QLatin1String("tick")).toDouble()));
+}
+
+// EVENEMENTS DE LA SIMULATION -------------------------------------------------------------
+
+void Room::candySpawned(int candyId, int placementId)
+{
+    const GameMap::CandyPlacement &placement = map->getCandyPlacements().at(placementId);
+    QJsonObject newCandy;
+    newCandy.insert("candyType", QJsonValue(placement.candyType));
+    newCandy.insert("candySize", QJsonValue(placement.candySize));
+    newCandy.insert("nbPoints", QJsonValue(placement.nbPoints));
+    newCandy.insert("tilePlacementId", QJsonValue(placementId));
+    newCandy.insert("candyId", QJsonValue(candyId));
+    sendEveryone(Protocol::NewCandy, newCandy);
+}
+
+void Room::candyTaken(qintptr descriptor, int candyId, quint32 generation)
+{
+    QJsonObject candyTaken;
+    candyTaken.insert("socketDescriptor", QJsonValue(descriptor));
+    candyTaken.insert("candyId", QJsonValue(candyId));
+    candyTaken.insert("generation", QJsonValue(qint64(generation)));
+    sendEveryone(Protocol::CandyTaken, candyTaken);
+}
+
+void Room::candiesStolen(qintptr descriptor, int candyIdStartingFrom, quint32 generation)
+{
+    QJsonObject candyStolen;
+    candyStolen.insert("socketDescriptor", QJsonValue(descriptor));
+    candyStolen.insert("candyIdStartingFrom", QJsonValue(candyIdStartingFrom));
+    candyStolen.insert("generation", QJsonValue(qint64(generation)));
+    sendEveryone(Protocol::StealCandies, candyStolen);
+}
+
+void Room::candiesValidated(qintptr descriptor, int nbCandies, int nbPoints)
+{
+    Logger::log(Logger::Debug, "Le joueur " + QString::number(descriptor) + " valide " + QString::number(nbCandies)
+                + " candies pour " + QString::number(nbPoints) + " points");
+    QJsonObject candyValidated;
+    candyValidated.insert("socketDescriptor", QJsonValue(descriptor));
+    sendEveryone(Protocol::ValidateCandies, candyValidated);
+    // Les nouveaux scores sans attendre la prochaine seconde
+    sendMatchClock();
+}
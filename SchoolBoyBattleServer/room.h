@@ -0,0 +1,160 @@
+/*
+ * Description : Cette classe représente une partie hébergée par le serveur.
+ *               Elle possède ses clients, ses candies et son état
+ *               (salle d'attente puis partie en cours). Le TcpServer place
+ *               chaque client dans une partie au moment du login, ce qui
+ *               permet d'héberger plusieurs parties en même temps.
+ *               Une partie vit dans un seul thread, avec les sockets de tous
+ *               ses clients : traitement des messages et envois se font sans
+ *               passer d'un thread à l'autre.
+ *               Pendant le jeu, elle fait avancer sa Simulation à pas fixe
+ *               et envoie à chaque client l'état des joueurs proches de lui.
+ *               Elle décide seule de la durée de la partie : le temps
+ *               restant et les scores sont envoyés aux clients, jusqu'aux
+ *               scores finaux.
+ *               Des bots peuvent occuper des places : ils jouent dans le
+ *               pas de la partie, sans socket.
+ *               La liste des joueurs est versionnée : un client reçoit la
+ *               liste complète en arrivant, puis seulement les changements.
+ *               Chaque pas est mesuré (simulation et envois) par rapport à
+ *               un budget. Une partie qui le dépasse se déleste par
+ *               niveaux : moins de joueurs lointains, puis moins de
+ *               snapshots, puis plus de nouvelle partie dans son thread.
+ *               Si le serveur enregistre les parties, tout ce qui entre et
+ *               sort pendant le jeu est confié à un MatchRecorder.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef ROOM_H
+#define ROOM_H
+
+#include "bot.h"
+#include "gamemap.h"
+#include "logger.h"
+#include "matchrecorder.h"
+#include "messagedispatcher.h"
+#include "protocol.h"
+#include "recordwriter.h"
+#include "serverworker.h"
+#include "simulation.h"
+#include "snapshotencoder.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonObject>
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
+
+class Room : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(Room)
+
+public:
+    // Délestage, chaque niveau garde ceux d'en dessous
+    enum LoadLevel : int {
+        LoadNormal = 0,
+        LoadFewerFarPlayers,    // Joueurs hors de la vue une fois par seconde
+        LoadFewerSnapshots,     // Un snapshot tous les deux pas
+        LoadSaturated,          // Le TcpServer ne crée plus de partie dans ce thread
+        NbLoadLevels            // Doit rester le dernier
+    };
+
+    Room(int id, int capacity, const GameMap *map, RecordWriter *recordWriter = nullptr, QObject *parent = nullptr);
+    ~Room();
+
+    int getId() const;
+    int getCapacity() const;
+    bool isStarted() const;
+    // Lisibles depuis n'importe quel thread
+    int getLoadLevel() const;
+    qint64 getTickCostNs() const;
+
+    // Places de la partie, uniquement depuis le thread du TcpServer
+    bool isJoinable() const;
+    bool isEmpty() const;
+    int getNbSeats() const;
+    bool hasUsername(const QString &username) const;
+    void reserveSeat(const QString &username);
+    void releaseSeat(const QString &username);
+
+    // Uniquement depuis le thread de la partie
+    void addClient(ServerWorker *client);
+    void removeClient(ServerWorker *client);
+    void messageReceived(ServerWorker *sender, int messageId, const QJsonObject &doc);
+    // Aussi avant que la partie soit déplacée dans son thread
+    bool addBot();
+
+    // Utilisé aussi par le TcpServer pour les clients qui ne sont dans aucune partie
+    static QByteArray encode(Protocol::MessageId messageId, const QJsonObject &message, qintptr destinationDescriptor = -1);
+
+private:
+    const int id;
+    const int capacity;                 // Taille de partie choisie par ses joueurs
+    std::atomic<bool> gameStarted;
+    QStringList usernames;              // Thread du TcpServer
+    std::atomic<int> nbReservedSeats;   // Places des clients, arrivés ou non, lues par la partie
+    QVector<ServerWorker *> clients;    // Thread de la partie
+    QVector<ServerWorker *> rejectedClients;    // Arrivés après le début, gardent leur place jusqu'à leur déconnexion
+    QVector<Bot> bots;                  // Thread de la partie
+    std::atomic<int> nbBots;            // Places des bots, lues par le TcpServer
+    const GameMap *map;                 // Partagé en lecture seule
+    Simulation *simulation;             // Thread de la partie
+    QTimer *tickTimer;
+    QElapsedTimer tickClock;
+    qint64 tickLagNs;                   // Temps pas encore simulé
+    // Budget des pas, mesuré par fenêtres d'une seconde
+    std::atomic<int> loadLevel;
+    std::atomic<qint64> tickCostNs;     // Coût moyen d'un pas sur la dernière fenêtre
+    int windowTicks;
+    int windowOverBudget;               // Pas trop longs ou trop en retard
+    qint64 windowCostNs;
+    int cleanWindows;                   // Fenêtres sans dépassement depuis le dernier changement de niveau
+    QHash<qintptr, SnapshotEncoder> snapshotEncoders;  // Par descriptor de client
+    RecordWriter *recordWriter;         // nullptr si les parties ne sont pas enregistrées
+    MatchRecorder *recorder;            // Partie en cours seulement
+    quint32 lobbyVersion;               // Incrémentée à chaque changement de la liste des joueurs
+    // Traitements des messages des clients, indexés par id de message
+    MessageDispatcher<ServerWorker *> dispatcher;
+
+    void registerHandlers();
+    void sendPacket(ServerWorker *destination, const QByteArray &packet, Protocol::MessageId messageId, qintptr coalesceKey = -1);
+    void sendJson(ServerWorker *destination, Protocol::MessageId messageId, const QJsonObject &message);
+    void sendEveryone(Protocol::MessageId messageId, const QJsonObject &message, qintptr coalesceKey = -1);
+    static QJsonObject lobbyUser(const ServerWorker *client);
+    static QJsonObject lobbyUser(const Bot &bot);
+    QJsonObject generateUserList();
+    void sendUserList(ServerWorker *destination);
+    void sendLobbyDiff(QJsonObject diff, ServerWorker *except = nullptr);
+    void checkEveryoneReady();
+    void startGame();
+    void tick();
+    void sendMatchClock();
+    void accountTick(qint64 costNs, qint64 lateNs);
+    void setLoadLevel(int level);
+    void endMatch();
+    void stopRecording();
+
+    // Traitements des messages des clients
+    void toggleReady(ServerWorker *sender, const QJsonObject &doc);
+    void updateUsersList(ServerWorker *sender, const QJsonObject &doc);
+    void playerMove(ServerWorker *sender, const QJsonObject &doc);
+    void claimCandy(ServerWorker *sender, const QJsonObject &doc);
+    void snapshotAck(ServerWorker *sender, const QJsonObject &doc);
+
+    // Evénements de la simulation, envoyés à tout le monde
+    void candySpawned(int candyId, int placementId);
+    void candyTaken(qintptr descriptor, int candyId, quint32 generation);
+    void candiesStolen(qintptr descriptor, int candyIdStartingFrom, quint32 generation);
+    void candiesValidated(qintptr descriptor, int nbCandies, int nbPoints);
+
+signals:
+    void clientLeft(ServerWorker *client);
+};
+
+#endif // ROOM_H
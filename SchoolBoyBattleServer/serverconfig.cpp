@@ -0,0 +1,161 @@
+/*
+ * Description : Cette classe regroupe la configuration du serveur.
+ *               Les valeurs sont lues depuis un fichier de configuration
+ *               (format INI) puis depuis la ligne de commande, qui a
+ *               toujours la priorité.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "serverconfig.h"
+#include "logger.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QSettings>
+
+#define DEFAULT_PORT 1962
+#define MAX_BOTS_PER_ROOM 7             // Une partie a 8 places, il en reste une pour un humain
+
+ServerConfig::ServerConfig() :
+    headless(false),
+    address(QHostAddress::Any),
+    port(DEFAULT_PORT),
+    threadCount(0),
+    logLevel(Logger::Info),
+    metricsPort(0),
+    botsPerRoom(0),
+    router(false),
+    shardCount(0),
+    shardPort(0)
+{}
+
+/*
+ * Le choix entre QApplication et QCoreApplication doit être fait avant
+ * de créer l'application, on regarde donc directement dans argv.
+ * Le routeur n'a jamais d'interface graphique.
+ */
+bool ServerConfig::isHeadless(int argc, char *argv[])
+{
+    for(int i = 1; i < argc; i++) {
+        if(qstrcmp(argv[i], "--headless") == 0 || qstrcmp(argv[i], "--router") == 0)
+            return true;
+    }
+    return false;
+}
+
+ServerConfig ServerConfig::fromArguments(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("SchoolBoyBattleServer");
+    parser.addHelpOption();
+
+    QCommandLineOption headlessOption("headless", "Démarre le serveur sans interface graphique.");
+    QCommandLineOption configOption({"c", "config"}, "Fichier de configuration (INI).", "file");
+    QCommandLineOption portOption({"p", "port"}, "Port d'écoute.", "port");
+    QCommandLineOption addressOption({"a", "address"}, "Adresse d'écoute.", "address");
+    QCommandLineOption threadsOption({"t", "threads"}, "Nombre de threads pour les clients.", "count");
+    QCommandLineOption logLevelOption({"l", "log-level"}, "Niveau de log (error, warning, info, debug).", "level");
+    QCommandLineOption logSampleOption("log-sample", "N'écrit qu'un paquet sur N pour ce type de message (ex : playerMove=10).", "type=N");
+    QCommandLineOption metricsPortOption("metrics-port", "Port HTTP local pour les métriques (GET /metrics).", "port");
+    QCommandLineOption recordDirOption("record-dir", "Enregistre chaque partie dans ce dossier.", "directory");
+    QCommandLineOption botsOption("bots", "Nombre de bots ajoutés à chaque nouvelle partie.", "count");
+    QCommandLineOption routerOption("router", "Démarre le routeur : il lance les shards et leur envoie les clients.");
+    QCommandLineOption shardsOption("shards", "Nombre de shards lancés par le routeur.", "count");
+    QCommandLineOption shardPortOption("shard-port", "Port du premier shard.", "port");
+    QCommandLineOption routerSocketOption("router-socket", "Socket locale du routeur (donnée aux shards par le routeur).", "name");
+    parser.addOptions({headlessOption, configOption, portOption, addressOption, threadsOption, logLevelOption, logSampleOption, metricsPortOption, recordDirOption, botsOption,
+                       routerOption, shardsOption, shardPortOption, routerSocketOption});
+    parser.process(arguments);
+
+    ServerConfig config;
+    config.headless = parser.isSet(headlessOption) || parser.isSet(routerOption);
+    config.router = parser.isSet(routerOption);
+
+    // Le fichier de configuration d'abord, la ligne de commande écrase ses valeurs
+    if(parser.isSet(configOption))
+        config.loadFile(parser.value(configOption));
+
+    if(parser.isSet(portOption))
+        config.port = parser.value(portOption).toUShort();
+    if(parser.isSet(addressOption))
+        config.address = QHostAddress(parser.value(addressOption));
+    if(parser.isSet(threadsOption))
+        config.threadCount = qMax(parser.value(threadsOption).toInt(), 0);
+    if(parser.isSet(logLevelOption))
+        config.logLevel = parseLogLevel(parser.value(logLevelOption), config.logLevel);
+    if(parser.isSet(metricsPortOption))
+        config.metricsPort = parser.value(metricsPortOption).toUShort();
+    if(parser.isSet(recordDirOption))
+        config.recordDir = parser.value(recordDirOption);
+    if(parser.isSet(botsOption))
+        config.botsPerRoom = parser.value(botsOption).toInt();
+    if(parser.isSet(shardsOption))
+        config.shardCount = qMax(parser.value(shardsOption).toInt(), 0);
+    if(parser.isSet(shardPortOption))
+        config.shardPort = parser.value(shardPortOption).toUShort();
+    if(parser.isSet(routerSocketOption))
+        config.routerSocket = parser.value(routerSocketOption);
+    for(const QString &sample : parser.values(logSampleOption)) {
+        const QStringList parts = sample.split('=');
+        if(parts.size() == 2 && parts.at(1).toInt() > 0)
+            config.logSampling.insert(parts.at(0), parts.at(1).toInt());
+    }
+
+    if(config.port == 0)
+        config.port = DEFAULT_PORT;
+    if(config.address.isNull())
+        config.address = QHostAddress::Any;
+    config.botsPerRoom = qBound(0, config.botsPerRoom, MAX_BOTS_PER_ROOM);
+    return config;
+}
+
+void ServerConfig::loadFile(const QString &fileName)
+{
+    QSettings settings(fileName, QSettings::IniFormat);
+    settings.beginGroup("server");
+    port = settings.value("port", port).toUInt();
+    address = QHostAddress(settings.value("address", address.toString()).toString());
+    threadCount = qMax(settings.value("threads", threadCount).toInt(), 0);
+    logLevel = parseLogLevel(settings.value("logLevel").toString(), logLevel);
+    metricsPort = settings.value("metricsPort", metricsPort).toUInt();
+    recordDir = settings.value("recordDir", recordDir).toString();
+    botsPerRoom = settings.value("bots", botsPerRoom).toInt();
+    shardCount = qMax(settings.value("shards", shardCount).toInt(), 0);
+    shardPort = settings.value("shardPort", shardPort).toUInt();
+    settings.endGroup();
+
+    settings.beginGroup("logSampling");
+    for(const QString &messageType : settings.childKeys()) {
+        if(settings.value(messageType).toInt() > 0)
+            logSampling.insert(messageType, settings.value(messageType).toInt());
+    }
+    settings.endGroup();
+}
+
+int ServerConfig::parseLogLevel(const QString &level, int defaultLevel)
+{
+    if(level.compare(QLatin1String("error"), Qt::CaseInsensitive) == 0)
+        return Logger::Error;
+    if(level.compare(QLatin1String("warning"), Qt::CaseInsensitive) == 0)
+        return Logger::Warning;
+    if(level.compare(QLatin1String("info"), Qt::CaseInsensitive) == 0)
+        return Logger::Info;
+    if(level.compare(QLatin1String("debug"), Qt::CaseInsensitive) == 0)
+        return Logger::Debug;
+    return defaultLevel;
+}
+
+QString ServerConfig::logLevelName(int level)
+{
+    switch(level) {
+    case Logger::Error:
+        return QStringLiteral("error");
+    case Logger::Warning:
+        return QStringLiteral("warning");
+    case Logger::Debug:
+        return QStringLiteral("debug");
+    default:
+        return QStringLiteral("info");
+    }
+}
@@ -0,0 +1,45 @@
+/*
+ * Description : Cette classe regroupe la configuration du serveur.
+ *               Les valeurs sont lues depuis un fichier de configuration
+ *               (format INI) puis depuis la ligne de commande, qui a
+ *               toujours la priorité.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef SERVERCONFIG_H
+#define SERVERCONFIG_H
+
+#include <QHash>
+#include <QHostAddress>
+#include <QStringList>
+
+class ServerConfig
+{
+public:
+    ServerConfig();
+    static bool isHeadless(int argc, char *argv[]);
+    static ServerConfig fromArguments(const QStringList &arguments);
+    static int parseLogLevel(const QString &level, int defaultLevel);
+    static QString logLevelName(int level);
+
+    bool headless;              // Sans interface graphique
+    QHostAddress address;       // Adresse d'écoute
+    quint16 port;               // Port d'écoute
+    int threadCount;            // Nombre de threads pour les clients (0 = automatique)
+    int logLevel;               // Niveau de log (Logger::Level)
+    QHash<QString, int> logSampling;    // Type de message -> n'en logger qu'un sur N
+    quint16 metricsPort;        // Port HTTP local des métriques (0 = désactivé)
+    QString recordDir;          // Dossier des enregistrements des parties (vide = désactivé)
+    int botsPerRoom;            // Bots ajoutés à chaque nouvelle partie (tests de charge)
+    bool router;                // Routeur : lance les shards et leur envoie les clients
+    int shardCount;             // Nombre de shards lancés par le routeur (0 = automatique)
+    quint16 shardPort;          // Port du premier shard, les suivants à la suite (0 = port + 1)
+    QString routerSocket;       // Shard : socket locale du routeur à qui envoyer la charge
+
+private:
+    void loadFile(const QString &fileName);
+};
+
+#endif // SERVERCONFIG_H
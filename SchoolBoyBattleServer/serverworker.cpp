@@ -2,68 +2,490 @@
  * Description : Cette classe représente chaque client connecté au serveur.
  *               C’est ici que l’objet QTcpSocket se trouve et également ici
  *               qu'on envoie les paquets au client qui lui sont assignés.
+ *               Les paquets à envoyer passent par une file bornée : si le
+ *               client ne lit pas assez vite, les états remplacés sont
+ *               fusionnés, puis supprimés, et le client est déconnecté
+ *               s'il reste trop longtemps au-dessus de son budget.
+ *               Pendant le jeu, les paquets d'un pas sont regroupés et
+ *               écrits en une seule fois à la fin du pas.
+ *               Les messages reçus passent par des seaux à jetons (un par
+ *               type de message et un pour tout le client) avant d'être
+ *               décodés : un client qui envoie trop est ignoré, puis
+ *               déconnecté s'il continue.
+ *               Un ping part toutes les 2 secondes pour mesurer le RTT, et
+ *               un client qui n'envoie plus rien (pas même de pong) est
+ *               déconnecté.
  * Version     : 1.0.0
  * Date        : 25.01.2021
  * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
 */
 
 #include "serverworker.h"
-#include <QDataStream>
-#include <QJsonDocument>
+#include "logger.h"
+#include "metrics.h"
+#include "protocol.h"
 #include <QJsonObject>
+#include <QTimer>
+
+// Au-dessus de SOCKET_HIGH_WATERMARK octets dans le buffer du socket, les paquets
+// restent dans la file. On recommence à écrire quand il repasse sous SOCKET_LOW_WATERMARK.
+#define SOCKET_HIGH_WATERMARK (64 * 1024)
+#define SOCKET_LOW_WATERMARK (16 * 1024)
+// Budget de la file : au-dessus, les états sont supprimés
+#define MAX_QUEUE_BYTES (256 * 1024)
+// Au-dessus, le client est déconnecté immédiatement
+#define HARD_QUEUE_BYTES (1024 * 1024)
+// Temps maximum passé au-dessus du budget avant d'être déconnecté
+#define OVER_BUDGET_TIMEOUT_MS 5000
+// Tous messages confondus, par client, sauf ceux de isTransportMessage
+#define CLIENT_MESSAGES_PER_SECOND 60
+#define CLIENT_MESSAGES_BURST 120
+// Un client qui dépasse ce nombre de messages ignorés dans la fenêtre est déconnecté
+#define OFFENSE_WINDOW_MS 10000
+#define MAX_RATE_LIMITED_IN_WINDOW 200
+// Le client répond aux pings même dans la salle d'attente : une connexion
+// qui ne reçoit plus rien pendant IDLE_TIMEOUT_MS est morte (connexion à
+// moitié ouverte, client figé) et libère sa place
+#define PING_INTERVAL_MS 2000
+#define IDLE_TIMEOUT_MS 10000
+// Lissage du RTT comme TCP : chaque mesure compte pour 1/8
+#define RTT_SMOOTHING 8
+// Les messages d'un client sont petits : un paquet plus grand est une
+// erreur ou une attaque, le client est déconnecté
+#define MAX_FRAME_SIZE (64 * 1024)
+
+// Messages par seconde et taille du seau, dans le même ordre que Protocol::MessageId.
+// Un joueur appuie et relâche au plus 4 touches de déplacement, 30 par seconde
+// laissent de la marge. Les messages que le client n'envoie plus ont une limite basse.
+static const double messageRates[Protocol::NbMessageIds][2] = {
+    {30, 60},   // playerMove
+    {2, 5},     // snapshot
+    {20, 40},   // claimCandy
+    {2, 5},     // candyTaken
+    {2, 5},     // stealCandies
+    {2, 5},     // validateCandies
+    {2, 5},     // newCandy
+    {1, 5},     // login
+    {4, 10},    // toggleReady
+    {2, 5},     // updateUsersList
+    {2, 5},     // startGame
+    {2, 5},     // userDisconnected
+    {5, 10},    // message
+    {2, 5},     // batch
+    {40, 80},   // snapshotAck
+    {2, 5},     // matchClock
+    {2, 5},     // matchEnd
+    {2, 5},     // queueStatus
+    {2, 5},     // redirect
+    {2, 5},     // shardLoad
+    {2, 5},     // ping
+    {2, 5},     // pong
+    {2, 5}      // lobbyDiff
+};
 
 ServerWorker::ServerWorker(QObject *parent) :
     QObject(parent),
     socket(new QTcpSocket(this)),
-    ready(false)
+    descriptor(-1),
+    heartbeatTimer(new QTimer(this)),
+    frameReader(MAX_FRAME_SIZE),
+    loggedIn(false),
+    ready(false),
+    gender(0),
+    team(0),
+    tickAligned(false),
+    flushScheduled(false),
+    outboundBytes(0),
+    backpressured(false),
+    queuedPackets(0),
+    queuedBytes(0),
+    droppedPackets(0),
+    rateLimitedInWindow(0),
+    offenseWindowStartMs(0),
+    lastReceivedMs(0),
+    rttMs(-1)
 {
+    // Les seaux commencent pleins
+    rateClock.start();
+    for(int i = 0; i < Protocol::NbMessageIds; i++)
+        messageBuckets[i] = TokenBucket{messageRates[i][1], 0};
+    clientBucket = TokenBucket{CLIENT_MESSAGES_BURST, 0};
+
     connect(socket, &QTcpSocket::readyRead, this, &ServerWorker::receiveJson);
+    connect(socket, &QTcpSocket::bytesWritten, this, &ServerWorker::onBytesWritten);
     connect(socket, &QTcpSocket::disconnected, this, &ServerWorker::disconnectedFromClient);
     connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error), this, &ServerWorker::error);
+    // Le timer suit le worker quand il change de thread
+    heartbeatTimer->setInterval(PING_INTERVAL_MS);
+    connect(heartbeatTimer, &QTimer::timeout, this, &ServerWorker::heartbeat);
+}
+
+/*
+ * Le paquet est déjà sérialisé et préfixé de sa taille par Room::encode,
+ * il est partagé (implicit sharing) entre tous les destinataires.
+ * coalesceKey identifie le joueur concerné par un message d'état : un état
+ * plus récent pour le même joueur remplace celui qui attend encore.
+ * Le paquet est gardé jusqu'au flush : à la fin du pas en jeu, sinon quand
+ * la boucle d'événements reprend la main.
+ */
+void ServerWorker::sendPacket(const QByteArray &packet, int messageId, qintptr coalesceKey) {
+    if(socket->state() != QAbstractSocket::ConnectedState)
+        return;
+    Metrics::messageOut(messageId, packet.size());
+
+    OutboundPacket pending;
+    pending.packet = packet;
+    pending.messageId = messageId;
+    pending.coalesceKey = coalesceKey;
+    pendingPackets.append(pending);
+    if(!tickAligned && !flushScheduled) {
+        flushScheduled = true;
+        QTimer::singleShot(0, this, &ServerWorker::flush);
+    }
+}
+
+void ServerWorker::setTickAligned(bool tickAligned) {
+    this->tickAligned = tickAligned;
+    if(!tickAligned && !pendingPackets.isEmpty())
+        flush();
+}
+
+/*
+ * Ecrit tous les paquets en attente en un seul batch, ou les met dans la
+ * file si le client est ralenti
+ */
+void ServerWorker::flush() {
+    flushScheduled = false;
+    if(pendingPackets.isEmpty())
+        return;
+    if(socket->state() != QAbstractSocket::ConnectedState) {
+        pendingPackets.clear();
+        return;
+    }
+
+    // Cas normal : rien en attente, on écrit directement dans le socket
+    if(!backpressured && outboundQueue.isEmpty()) {
+        QList<QByteArray> packets;
+        packets.reserve(pendingPackets.size());
+        for(int i = 0; i < pendingPackets.size(); i++)
+            packets.append(pendingPackets.at(i).packet);
+        pendingPackets.clear();
+        writeBatch(packets);
+        if(socket->bytesToWrite() >= SOCKET_HIGH_WATERMARK) {
+            backpressured = true;
+            Logger::log(Logger::Debug, "Client " + QString::number(socket->socketDescriptor()) + " ralenti, mise en file des paquets");
+        }
+        return;
+    }
+
+    for(int i = 0; i < pendingPackets.size(); i++)
+        enqueue(pendingPackets.at(i).packet, pendingPackets.at(i).messageId, pendingPackets.at(i).coalesceKey);
+    pendingPackets.clear();
+    enforceBudget();
+    updateQueueMetrics();
+}
+
+/*
+ * Les pings et pongs ne servent qu'à mesurer le délai : ils n'attendent
+ * pas la fin du pas, sauf si le client est déjà ralenti
+ */
+void ServerWorker::sendNow(const QByteArray &packet, int messageId) {
+    if(socket->state() != QAbstractSocket::ConnectedState)
+        return;
+    Metrics::messageOut(messageId, packet.size());
+    if(backpressured || !outboundQueue.isEmpty()) {
+        enqueue(packet, messageId, -1);
+        enforceBudget();
+        updateQueueMetrics();
+        return;
+    }
+    writeBatch(QList<QByteArray>() << packet);
 }
 
-void ServerWorker::sendJson(const QJsonObject &json) {
-    const QByteArray jsonData = QJsonDocument(json).toJson(QJsonDocument::Compact);
-    emit logMessage("Envoi à " + QString::number(socket->socketDescriptor()) + " - " + QString::fromUtf8(jsonData));
-    QDataStream socketStream(socket);
-    socketStream.setVersion(QDataStream::Qt_5_9);
-    socketStream << jsonData;
+void ServerWorker::writeBatch(const QList<QByteArray> &packets) {
+    const QByteArray batch = Protocol::batch(packets);
+    socket->write(batch);
+    Metrics::socketWrite(batch.size());
+}
+
+int ServerWorker::getQueuedPackets() const {
+    return queuedPackets.load(std::memory_order_relaxed);
+}
+
+int ServerWorker::getQueuedBytes() const {
+    return queuedBytes.load(std::memory_order_relaxed);
+}
+
+quint64 ServerWorker::getDroppedPackets() const {
+    return droppedPackets.load(std::memory_order_relaxed);
+}
+
+/*
+ * RTT lissé en millisecondes, -1 tant qu'aucun pong n'est revenu
+ */
+int ServerWorker::getRttMs() const {
+    return rttMs.load(std::memory_order_relaxed);
+}
+
+/*
+ * Appelé toutes les PING_INTERVAL_MS : déconnecte le client s'il n'a rien
+ * envoyé depuis trop longtemps, sinon lui envoie un ping. La déconnexion
+ * passe par le signal disconnected habituel, qui libère la partie et le
+ * thread.
+ */
+void ServerWorker::heartbeat() {
+    if(socket->state() != QAbstractSocket::ConnectedState)
+        return;
+    const qint64 nowMs = rateClock.elapsed();
+    if(nowMs - lastReceivedMs > IDLE_TIMEOUT_MS) {
+        Logger::log(Logger::Warning, "Client " + QString::number(socket->socketDescriptor()) + " inactif depuis "
+                    + QString::number(nowMs - lastReceivedMs) + " ms, déconnexion");
+        Metrics::idleDisconnect();
+        heartbeatTimer->stop();
+        socket->abort();
+        return;
+    }
+    // Un client ralenti qui ne reçoit plus rien d'autre est aussi vérifié ici
+    enforceBudget();
+    updateQueueMetrics();
+    if(socket->state() != QAbstractSocket::ConnectedState)
+        return;
+    QJsonObject ping;
+    ping[QStringLiteral("t")] = nowMs;
+    sendNow(Protocol::frame(Protocol::encode(Protocol::Ping, ping)), Protocol::Ping);
+}
+
+/*
+ * Les pings du client reçoivent leur pong tout de suite ; les pongs du
+ * client mesurent le RTT à partir de l'heure de notre ping
+ */
+void ServerWorker::onHeartbeatMessage(int messageId, const QJsonObject &message) {
+    if(messageId == Protocol::Ping) {
+        sendNow(Protocol::frame(Protocol::encode(Protocol::Pong, message)), Protocol::Pong);
+        return;
+    }
+    const qint64 sentMs = qint64(message.value(QLatin1String("t")).toDouble(-1));
+    const qint64 sampleMs = rateClock.elapsed() - sentMs;
+    if(sentMs < 0 || sampleMs < 0)
+        return;
+    const int previousMs = rttMs.load(std::memory_order_relaxed);
+    const int smoothedMs = previousMs < 0 ? int(sampleMs) : int(previousMs + (sampleMs - previousMs) / RTT_SMOOTHING);
+    rttMs.store(smoothedMs, std::memory_order_relaxed);
+}
+
+/*
+ * Seuls les états complets (snapshots) peuvent être fusionnés ou supprimés,
+ * les événements (déplacements, candies, lobby) doivent tous arriver
+ */
+bool ServerWorker::isCoalescable(int messageId) {
+    return messageId == Protocol::Snapshot;
+}
+
+void ServerWorker::enqueue(const QByteArray &packet, int messageId, qintptr coalesceKey) {
+    if(isCoalescable(messageId) && coalesceKey >= 0) {
+        // L'ancien état est retiré et le nouveau mis à la fin, pour garder l'ordre
+        // avec les événements envoyés entre les deux
+        for(int i = outboundQueue.size() - 1; i >= 0; i--) {
+            const OutboundPacket &queued = outboundQueue.at(i);
+            if(queued.messageId == messageId && queued.coalesceKey == coalesceKey) {
+                outboundBytes -= queued.packet.size();
+                outboundQueue.removeAt(i);
+                droppedPackets.fetch_add(1, std::memory_order_relaxed);
+                Metrics::messagesDropped(messageId, 1);
+                break;
+            }
+        }
+    }
+    OutboundPacket queued;
+    queued.packet = packet;
+    queued.messageId = messageId;
+    queued.coalesceKey = coalesceKey;
+    outboundQueue.append(queued);
+    outboundBytes += packet.size();
+}
+
+/*
+ * Les paquets de la file sont aussi regroupés, jusqu'à la limite haute
+ */
+void ServerWorker::flushQueue() {
+    QList<QByteArray> packets;
+    int batchBytes = 0;
+    while(!outboundQueue.isEmpty() && socket->bytesToWrite() + batchBytes < SOCKET_HIGH_WATERMARK) {
+        const OutboundPacket queued = outboundQueue.takeFirst();
+        outboundBytes -= queued.packet.size();
+        batchBytes += queued.packet.size();
+        packets.append(queued.packet);
+    }
+    if(!packets.isEmpty())
+        writeBatch(packets);
+    backpressured = !outboundQueue.isEmpty() || socket->bytesToWrite() >= SOCKET_HIGH_WATERMARK;
+    if(outboundBytes <= MAX_QUEUE_BYTES)
+        overBudgetTimer.invalidate();
+    updateQueueMetrics();
+}
+
+/*
+ * Supprime tous les états en attente, le client recevra le prochain
+ */
+void ServerWorker::dropStaleState() {
+    int nbDropped = 0;
+    for(int i = outboundQueue.size() - 1; i >= 0; i--) {
+        if(isCoalescable(outboundQueue.at(i).messageId)) {
+            outboundBytes -= outboundQueue.at(i).packet.size();
+            outboundQueue.removeAt(i);
+            nbDropped++;
+        }
+    }
+    droppedPackets.fetch_add(nbDropped, std::memory_order_relaxed);
+    Metrics::messagesDropped(Protocol::Snapshot, nbDropped);
+}
+
+/*
+ * Au-dessus du budget : on supprime d'abord les états, puis si ça ne suffit
+ * pas et que ça dure, on déconnecte le client plutôt que de garder sa file
+ */
+void ServerWorker::enforceBudget() {
+    if(outboundBytes <= MAX_QUEUE_BYTES) {
+        overBudgetTimer.invalidate();
+        return;
+    }
+    dropStaleState();
+    if(outboundBytes <= MAX_QUEUE_BYTES) {
+        overBudgetTimer.invalidate();
+        return;
+    }
+
+    if(!overBudgetTimer.isValid())
+        overBudgetTimer.start();
+    if(outboundBytes > HARD_QUEUE_BYTES || overBudgetTimer.elapsed() > OVER_BUDGET_TIMEOUT_MS) {
+        Logger::log(Logger::Warning, "Client " + QString::number(socket->socketDescriptor()) + " trop lent, déconnexion ("
+                    + QString::number(outboundBytes) + " octets en attente)");
+        droppedPackets.fetch_add(outboundQueue.size(), std::memory_order_relaxed);
+        for(int i = 0; i < outboundQueue.size(); i++)
+            Metrics::messagesDropped(outboundQueue.at(i).messageId, 1);
+        outboundQueue.clear();
+        outboundBytes = 0;
+        socket->abort();
+    }
+}
+
+void ServerWorker::updateQueueMetrics() {
+    queuedPackets.store(outboundQueue.size(), std::memory_order_relaxed);
+    queuedBytes.store(outboundBytes, std::memory_order_relaxed);
+}
+
+void ServerWorker::onBytesWritten() {
+    if(!backpressured)
+        return;
+    // Hystérésis : on attend que le socket soit bien vidé avant de recommencer
+    if(socket->bytesToWrite() > SOCKET_LOW_WATERMARK)
+        return;
+    flushQueue();
 }
 
 void ServerWorker::disconnectFromClient() {
     socket->disconnectFromHost();
 }
 
+/*
+ * Ne doit être appelé qu'une fois, au login
+ */
 void ServerWorker::setUsername(const QString &username) {
-    usernameLock.lockForWrite();
+    Q_ASSERT(!loggedIn.load(std::memory_order_relaxed));
     this->username = username;
-    usernameLock.unlock();
+    // Publie le username pour les autres threads
+    loggedIn.store(true, std::memory_order_release);
 }
 
-void ServerWorker::receiveJson() {
-    QByteArray jsonData;
-    QDataStream socketStream(socket);
+/*
+ * Retourne false s'il n'y a plus de jeton dans le seau
+ */
+bool ServerWorker::takeToken(TokenBucket &bucket, qint64 nowMs, double ratePerSecond, double burst) {
+    bucket.tokens = qMin(burst, bucket.tokens + (nowMs - bucket.lastRefillMs) * ratePerSecond / 1000);
+    bucket.lastRefillMs = nowMs;
+    if(bucket.tokens < 1)
+        return false;
+    bucket.tokens--;
+    return true;
+}
 
-    socketStream.setVersion(QDataStream::Qt_5_9);
+/*
+ * Les acks de snapshots et le heartbeat arrivent à un rythme fixé par le
+ * serveur : ils n'ont que leur propre limite, sinon les acks (un par pas)
+ * prendraient la moitié du seau du client aux touches et aux candies
+ */
+bool ServerWorker::isTransportMessage(int messageId) {
+    return messageId == Protocol::SnapshotAck || messageId == Protocol::Ping || messageId == Protocol::Pong;
+}
 
-    while(true) {
-        socketStream.startTransaction();
-        socketStream >> jsonData;
+/*
+ * Vérifié avec le seul id du message, avant de décoder le JSON. Un message
+ * refusé est compté mais ne coûte rien d'autre, pas même un log.
+ */
+bool ServerWorker::acceptMessage(int messageId) {
+    const qint64 nowMs = rateClock.elapsed();
+    // Le seau du client n'est pas touché si le type de message est déjà à sec
+    bool accepted = Protocol::isValid(messageId)
+            ? takeToken(messageBuckets[messageId], nowMs, messageRates[messageId][0], messageRates[messageId][1])
+            : true;
+    if(!isTransportMessage(messageId))
+        accepted = accepted && takeToken(clientBucket, nowMs, CLIENT_MESSAGES_PER_SECOND, CLIENT_MESSAGES_BURST);
+    if(accepted)
+        return true;
 
-        if(socketStream.commitTransaction()) {
-            QJsonParseError parseError;
-            const QJsonDocument jsonDoc = QJsonDocument::fromJson(jsonData, &parseError);
-            if(parseError.error == QJsonParseError::NoError) {
-                if(jsonDoc.isObject())
-                    emit jsonRecieved(jsonDoc.object());
+    if(Protocol::isValid(messageId))
+        Metrics::messageRateLimited(messageId);
+    if(nowMs - offenseWindowStartMs > OFFENSE_WINDOW_MS) {
+        offenseWindowStartMs = nowMs;
+        rateLimitedInWindow = 0;
+    }
+    if(++rateLimitedInWindow > MAX_RATE_LIMITED_IN_WINDOW) {
+        Logger::log(Logger::Warning, "Client " + QString::number(socket->socketDescriptor()) + " envoie trop de messages, déconnexion");
+        socket->abort();
+    }
+    return false;
+}
+
+/*
+ * Les paquets sont lus dans le buffer du FrameReader, sans copie. Le
+ * Logger garde ses paquets plus longtemps que le buffer : ils sont copiés
+ * pour lui seulement.
+ */
+void ServerWorker::receiveJson() {
+    // Même un message incomplet prouve que le client est vivant
+    lastReceivedMs = rateClock.elapsed();
+
+    QByteArray jsonData;
+    // Un appel ne lit qu'un paquet au plus : readyRead n'est pas réémis pour
+    // les octets déjà reçus, il faut donc tout lire avant de rendre la main
+    do {
+        frameReader.readFrom(socket);
+        while(frameReader.nextFrame(&jsonData)) {
+            // Le client a été déconnecté pendant cette lecture
+            if(socket->state() != QAbstractSocket::ConnectedState)
+                return;
+            if(jsonData.isEmpty() || !acceptMessage(static_cast<quint8>(jsonData.at(0))))
+                continue;
+            int messageId;
+            QJsonObject jsonObj;
+            if(Protocol::decode(jsonData, &messageId, &jsonObj)) {
+                if(Logger::isEnabled(Logger::Debug) && Logger::isSampled(messageId))
+                    Logger::logPacket(Logger::Debug, Logger::PacketIn, descriptor, QByteArray(jsonData.constData(), jsonData.size()));
+                Metrics::messageIn(messageId, jsonData.size());
+                if(messageId == Protocol::Ping || messageId == Protocol::Pong)
+                    onHeartbeatMessage(messageId, jsonObj);
                 else
-                    emit logMessage("Message invalide : " + QString::fromUtf8(jsonData));
+                    emit messageReceived(messageId, jsonObj);
             } else {
-                emit logMessage("Message invalide : " + QString::fromUtf8(jsonData));
+                Metrics::invalidMessageIn(jsonData.size());
+                Logger::logPacket(Logger::Warning, Logger::InvalidPacket, descriptor, QByteArray(jsonData.constData(), jsonData.size()));
             }
-        } else {
-            break;
         }
+    } while(socket->bytesAvailable() > 0 && !frameReader.hasError());
+    if(frameReader.hasError()) {
+        Logger::log(Logger::Warning, "Client " + QString::number(descriptor) + " envoie un paquet trop grand, déconnexion");
+        Metrics::invalidMessageIn(0);
+        socket->abort();
     }
 }
 
@@ -71,55 +493,54 @@ void ServerWorker::receiveJson() {
 
 bool ServerWorker::setSocketDescriptor(qintptr socketDescriptor) {
     // Retourne un bool pou
-    return socket->setSocketDescriptor(socketDescriptor);
+    if(!socket->setSocketDescriptor(socketDescriptor))
+        return false;
+    descriptor = socketDescriptor;
+    // Les paquets sont déjà regroupés par pas, Nagle ne ferait que les retarder
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    lastReceivedMs = rateClock.elapsed();
+    heartbeatTimer->start();
+    return true;
 }
 
 qintptr ServerWorker::getSocketDescriptor() {
-    return socket->socketDescriptor();
+    return descriptor;
+}
+
+bool ServerWorker::isConnected() const {
+    return socket->state() == QAbstractSocket::ConnectedState;
+}
+
+bool ServerWorker::isLoggedIn() const {
+    return loggedIn.load(std::memory_order_acquire);
 }
 
 QString ServerWorker::getUsername() const {
-    usernameLock.lockForRead();
-    const QString result = username;
-    usernameLock.unlock();
-    return result;
+    if(!isLoggedIn())
+        return QString();
+    return username;
 }
 
 bool ServerWorker::getReady() const {
-    readyLock.lockForRead();
-    const bool result = ready;
-    readyLock.unlock();
-    return result;
+    return ready.load(std::memory_order_relaxed);
 }
 
 void ServerWorker::setReady(const bool ready) {
-    readyLock.lockForWrite();
-    this->ready = ready;
-    readyLock.unlock();
+    this->ready.store(ready, std::memory_order_relaxed);
 }
 
-int ServerWorker::getGender() {
-    genderLock.lockForRead();
-    const int result = gender;
-    genderLock.unlock();
-    return result;
+int ServerWorker::getGender() const {
+    return gender.load(std::memory_order_relaxed);
 }
 
 void ServerWorker::setGender(int gender) {
-    genderLock.lockForWrite();
-    this->gender = gender;
-    genderLock.unlock();
+    this->gender.store(gender, std::memory_order_relaxed);
 }
 
-int ServerWorker::getTeam() {
-    teamLock.lockForRead();
-    const int result = team;
-    teamLock.unlock();
-    return result;
+int ServerWorker::getTeam() const {
+    return team.load(std::memory_order_relaxed);
 }
 
 void ServerWorker::setTeam(int team) {
-    teamLock.lockForWrite();
-    this->team = team;
-    teamLock.unlock();
+    this->team.store(team, std::memory_order_relaxed);
 }
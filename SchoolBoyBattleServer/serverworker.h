@@ -2,6 +2,19 @@
  * Description : Cette classe représente chaque client connecté au serveur.
  *               C’est ici que l’objet QTcpSocket se trouve et également ici
  *               qu'on envoie les paquets au client qui lui sont assignés.
+ *               Les paquets à envoyer passent par une file bornée : si le
+ *               client ne lit pas assez vite, les états remplacés sont
+ *               fusionnés, puis supprimés, et le client est déconnecté
+ *               s'il reste trop longtemps au-dessus de son budget.
+ *               Pendant le jeu, les paquets d'un pas sont regroupés et
+ *               écrits en une seule fois à la fin du pas.
+ *               Les messages reçus passent par des seaux à jetons (un par
+ *               type de message et un pour tout le client) avant d'être
+ *               décodés : un client qui envoie trop est ignoré, puis
+ *               déconnecté s'il continue.
+ *               Un ping part toutes les 2 secondes pour mesurer le RTT, et
+ *               un client qui n'envoie plus rien (pas même de pong) est
+ *               déconnecté.
  * Version     : 1.0.0
  * Date        : 25.01.2021
  * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
@@ -10,9 +23,15 @@
 #ifndef SERVERWORKER_H
 #define SERVERWORKER_H
 
+#include "framereader.h"
+#include "protocol.h"
+
+#include <QElapsedTimer>
+#include <QList>
 #include <QObject>
-#include <QReadWriteLock>
 #include <QTcpSocket>
+#include <QTimer>
+#include <atomic>
 
 class ServerWorker : public QObject
 {
@@ -21,33 +40,96 @@ class ServerWorker : public QObject
 
 public:
     ServerWorker(QObject *parent = nullptr);
-    void sendJson(const QJsonObject &jsonData);
+    void sendPacket(const QByteArray &packet, int messageId, qintptr coalesceKey = -1);
+    // Les paquets ne sont plus écrits que par flush, appelé à la fin de chaque pas
+    void setTickAligned(bool tickAligned);
+    void flush();
+
+    // Lisibles depuis n'importe quel thread (métriques)
+    int getQueuedPackets() const;
+    int getQueuedBytes() const;
+    quint64 getDroppedPackets() const;
+    int getRttMs() const;
 
     // Getters / setters
     qintptr getSocketDescriptor();
     virtual bool setSocketDescriptor(qintptr socketDescriptor);
+    bool isConnected() const;
+    bool isLoggedIn() const;
     QString getUsername() const;
     void setUsername(const QString &username);
     bool getReady() const;
     void setReady(const bool ready);
-    int getGender();
+    int getGender() const;
     void setGender(int gender);
-    int getTeam();
-    void setTeam(int gender);
+    int getTeam() const;
+    void setTeam(int team);
 
 private:
+    typedef struct OutboundPacket_s {
+        QByteArray packet;      // Partagé implicitement avec les autres destinataires
+        int messageId;
+        qintptr coalesceKey;    // Le joueur concerné par un état, -1 sinon
+    } OutboundPacket;
+
+    // Seau à jetons : un message coûte un jeton, les jetons reviennent
+    // à un rythme fixe jusqu'à la taille du seau
+    typedef struct TokenBucket_s {
+        double tokens;
+        qint64 lastRefillMs;
+    } TokenBucket;
+
     // Les  propriétés d'un client
     QTcpSocket *socket;         // Son socket
+    // Gardé après la déconnexion : c'est aussi l'id du joueur dans sa partie
+    qintptr descriptor;
+    QTimer *heartbeatTimer;     // Pings et détection des connexions mortes
+    FrameReader frameReader;    // Paquets reçus, lus sans copie
+    // Le username n'est écrit qu'une fois, avant que loggedIn passe à true :
+    // ensuite il peut être lu depuis n'importe quel thread sans verrou
     QString username;           // Son nom d'utilisateur
-    bool ready;                 // S'il est prêt
-    int gender;                 // Son genre
-    int team;                   // Sa team
+    std::atomic<bool> loggedIn; // S'il a un nom d'utilisateur
+    std::atomic<bool> ready;    // S'il est prêt
+    std::atomic<int> gender;    // Son genre
+    std::atomic<int> team;      // Sa team
+
+    // Paquets du pas en cours, pas encore écrits
+    QList<OutboundPacket> pendingPackets;
+    bool tickAligned;
+    bool flushScheduled;
+
+    // File d'envoi, uniquement utilisée par le thread du worker
+    QList<OutboundPacket> outboundQueue;
+    int outboundBytes;
+    bool backpressured;         // Le socket a atteint la limite haute
+    QElapsedTimer overBudgetTimer;
+    std::atomic<int> queuedPackets;
+    std::atomic<int> queuedBytes;
+    std::atomic<quint64> droppedPackets;
+
+    // Limites des messages reçus, uniquement utilisées par le thread du worker
+    QElapsedTimer rateClock;
+    TokenBucket messageBuckets[Protocol::NbMessageIds];
+    TokenBucket clientBucket;
+    int rateLimitedInWindow;    // Messages ignorés depuis le début de la fenêtre
+    qint64 offenseWindowStartMs;
+
+    // Heartbeat, sur la même horloge que les seaux
+    qint64 lastReceivedMs;
+    std::atomic<int> rttMs;     // Lisible depuis n'importe quel thread
 
-    // Les mutable pour les threads
-    mutable QReadWriteLock usernameLock;
-    mutable QReadWriteLock readyLock;
-    mutable QReadWriteLock genderLock;
-    mutable QReadWriteLock teamLock;
+    static bool isCoalescable(int messageId);
+    void writeBatch(const QList<QByteArray> &packets);
+    void sendNow(const QByteArray &packet, int messageId);
+    void onHeartbeatMessage(int messageId, const QJsonObject &message);
+    void enqueue(const QByteArray &packet, int messageId, qintptr coalesceKey);
+    void flushQueue();
+    void dropStaleState();
+    void enforceBudget();
+    void updateQueueMetrics();
+    static bool takeToken(TokenBucket &bucket, qint64 nowMs, double ratePerSecond, double burst);
+    static bool isTransportMessage(int messageId);
+    bool acceptMessage(int messageId);
 
 
 public slots:
@@ -55,12 +137,13 @@ public slots:
 
 private slots:
     void receiveJson();
+    void onBytesWritten();
+    void heartbeat();
 
 signals:
-    void jsonRecieved(const QJsonObject &jsonDoc);
+    void messageReceived(int messageId, const QJsonObject &message);
     void disconnectedFromClient();
     void error();
-    void logMessage(const QString &msg);
 };
 
 #endif // SERVERWORKER_H
@@ -0,0 +1,56 @@
+/*
+ * Description : Cette classe tourne dans un shard lancé par le routeur.
+ *               Elle se connecte à la socket locale du routeur et lui
+ *               envoie chaque seconde la charge du TcpServer (clients,
+ *               parties, file d'attente), pour qu'il choisisse le shard
+ *               le moins chargé. Si le routeur disparaît, elle se
+ *               reconnecte ; le shard continue à servir ses parties.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "shardreporter.h"
+#include "logger.h"
+#include "protocol.h"
+#include <QJsonObject>
+
+#define REPORT_INTERVAL_MS 1000
+
+ShardReporter::ShardReporter(const TcpServer *server, const QString &routerSocket, QObject *parent) :
+    QObject(parent),
+    server(server),
+    routerSocket(routerSocket),
+    socket(new QLocalSocket(this)),
+    reportTimer(new QTimer(this))
+{
+    reportTimer->setInterval(REPORT_INTERVAL_MS);
+    connect(reportTimer, &QTimer::timeout, this, &ShardReporter::report);
+    // Premier rapport dès la connexion, le routeur n'envoie personne avant
+    connect(socket, &QLocalSocket::connected, this, &ShardReporter::report);
+}
+
+/*
+ * A appeler une fois le TcpServer en écoute : le port annoncé est le sien
+ */
+void ShardReporter::start()
+{
+    socket->connectToServer(routerSocket);
+    reportTimer->start();
+}
+
+void ShardReporter::report()
+{
+    if(socket->state() != QLocalSocket::ConnectedState) {
+        if(socket->state() == QLocalSocket::UnconnectedState)
+            socket->connectToServer(routerSocket);
+        return;
+    }
+    QJsonObject load;
+    load.insert("port", server->serverPort());
+    load.insert("clients", server->getNbClients());
+    load.insert("rooms", server->getNbRooms());
+    load.insert("queued", server->getNbQueued());
+    load.insert("saturated", server->isSaturated());
+    socket->write(Protocol::frame(Protocol::encode(Protocol::ShardLoad, load)));
+}
@@ -0,0 +1,41 @@
+/*
+ * Description : Cette classe tourne dans un shard lancé par le routeur.
+ *               Elle se connecte à la socket locale du routeur et lui
+ *               envoie chaque seconde la charge du TcpServer (clients,
+ *               parties, file d'attente), pour qu'il choisisse le shard
+ *               le moins chargé. Si le routeur disparaît, elle se
+ *               reconnecte ; le shard continue à servir ses parties.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef SHARDREPORTER_H
+#define SHARDREPORTER_H
+
+#include "tcpserver.h"
+
+#include <QLocalSocket>
+#include <QObject>
+#include <QTimer>
+
+class ShardReporter : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(ShardReporter)
+
+public:
+    ShardReporter(const TcpServer *server, const QString &routerSocket, QObject *parent = nullptr);
+    void start();
+
+private:
+    const TcpServer *server;
+    const QString routerSocket;
+    QLocalSocket *socket;
+    QTimer *reportTimer;
+
+private slots:
+    void report();
+};
+
+#endif // SHARDREPORTER_H
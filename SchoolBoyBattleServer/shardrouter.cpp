@@ -0,0 +1,276 @@
+/*
+ * Description : Cette classe est le routeur du mode multi-processus
+ *               (--router). Elle lance un processus serveur (shard) par
+ *               coeur, chacun avec ses propres parties sur son propre port,
+ *               et écoute le port public. Chaque nouveau client reçoit un
+ *               message redirect vers le shard le moins chargé, puis le
+ *               routeur ferme la connexion : il ne voit passer aucun
+ *               message de jeu. Les shards envoient leur charge chaque
+ *               seconde par une socket locale et sont relancés s'ils
+ *               s'arrêtent.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "shardrouter.h"
+#include "logger.h"
+#include "protocol.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QHashIterator>
+#include <QJsonObject>
+#include <QThread>
+#include <QTimer>
+
+#define SHARD_RESTART_DELAY_MS 1000
+#define SHARD_STOP_TIMEOUT_MS 2000
+// Un shard qui ne donne plus de nouvelles ne reçoit plus de clients
+#define SHARD_REPORT_TIMEOUT_MS 3000
+// Un rapport de charge ne fait que quelques dizaines d'octets
+#define MAX_LOAD_FRAME_SIZE (4 * 1024)
+
+ShardRouter::ShardRouter(const ServerConfig &config, QObject *parent) :
+    QObject(parent),
+    config(config),
+    publicServer(new QTcpServer(this)),
+    loadServer(new QLocalServer(this)),
+    stopping(false)
+{
+    connect(publicServer, &QTcpServer::newConnection, this, &ShardRouter::onNewClient);
+    connect(loadServer, &QLocalServer::newConnection, this, &ShardRouter::onNewShardSocket);
+}
+
+ShardRouter::~ShardRouter()
+{
+    stop();
+    qDeleteAll(loadReaders);
+    loadReaders.clear();
+}
+
+bool ShardRouter::start()
+{
+    if(!publicServer->listen(config.address, config.port)) {
+        Logger::log(Logger::Error, "Impossible de démarrer le routeur : " + publicServer->errorString());
+        return false;
+    }
+    // Une socket par routeur, plusieurs routeurs peuvent tourner sur la même machine
+    const QString loadSocketName = "sbb-router-" + QString::number(publicServer->serverPort());
+    QLocalServer::removeServer(loadSocketName);
+    if(!loadServer->listen(loadSocketName)) {
+        Logger::log(Logger::Error, "Impossible d'ouvrir la socket des shards : " + loadServer->errorString());
+        return false;
+    }
+
+    const int nbShards = config.shardCount > 0 ? config.shardCount : QThread::idealThreadCount();
+    const quint16 firstPort = config.shardPort != 0 ? config.shardPort : publicServer->serverPort() + 1;
+    for(int i = 0; i < nbShards; i++) {
+        Shard shard;
+        shard.index = i;
+        shard.port = firstPort + i;
+        shard.process = nullptr;
+        shard.socket = nullptr;
+        shard.nbClients = 0;
+        shard.nbRooms = 0;
+        shard.nbQueued = 0;
+        shard.saturated = false;
+        shard.redirectedSinceReport = 0;
+        shard.lastReportMs = 0;
+        shards.append(shard);
+    }
+    for(int i = 0; i < shards.size(); i++)
+        startShard(i);
+
+    Logger::log(Logger::Info, "Routeur démarré");
+    Logger::log(Logger::Info, "Adresse du routeur : " + publicServer->serverAddress().toString());
+    Logger::log(Logger::Info, "Port : " + QString::number(publicServer->serverPort()));
+    Logger::log(Logger::Info, QString::number(nbShards) + " shards à partir du port " + QString::number(firstPort));
+    return true;
+}
+
+/*
+ * Les shards reçoivent SIGTERM et ferment leurs parties eux-mêmes
+ */
+void ShardRouter::stop()
+{
+    if(stopping)
+        return;
+    stopping = true;
+    publicServer->close();
+    for(int i = 0; i < shards.size(); i++) {
+        if(shards.at(i).process != nullptr)
+            shards.at(i).process->terminate();
+    }
+    for(int i = 0; i < shards.size(); i++) {
+        QProcess *process = shards.at(i).process;
+        if(process != nullptr && !process->waitForFinished(SHARD_STOP_TIMEOUT_MS))
+            process->kill();
+    }
+    loadServer->close();
+}
+
+/*
+ * Un shard est le même exécutable en --headless, sur son propre port
+ */
+QStringList ShardRouter::shardArguments(const Shard &shard) const
+{
+    QStringList arguments;
+    arguments << "--headless"
+              << "--port" << QString::number(shard.port)
+              // Un processus par coeur : un seul thread de clients par shard par défaut
+              << "--threads" << QString::number(config.threadCount > 0 ? config.threadCount : 1)
+              << "--log-level" << ServerConfig::logLevelName(config.logLevel)
+              << "--router-socket" << loadServer->serverName();
+    if(config.address != QHostAddress::Any)
+        arguments << "--address" << config.address.toString();
+    if(config.metricsPort != 0)
+        arguments << "--metrics-port" << QString::number(config.metricsPort + 1 + shard.index);
+    if(!config.recordDir.isEmpty())
+        arguments << "--record-dir" << config.recordDir;
+    if(config.botsPerRoom > 0)
+        arguments << "--bots" << QString::number(config.botsPerRoom);
+    QHashIterator<QString, int> i(config.logSampling);
+    while(i.hasNext()) {
+        i.next();
+        arguments << "--log-sample" << i.key() + "=" + QString::number(i.value());
+    }
+    return arguments;
+}
+
+void ShardRouter::startShard(int index)
+{
+    Shard &shard = shards[index];
+    if(shard.process == nullptr) {
+        shard.process = new QProcess(this);
+        // Les logs des shards arrivent sur la sortie du routeur
+        shard.process->setProcessChannelMode(QProcess::ForwardedChannels);
+        connect(shard.process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [=]() {
+            onShardFinished(index);
+        });
+    }
+    shard.lastReportMs = 0;
+    shard.process->start(QCoreApplication::applicationFilePath(), shardArguments(shard));
+}
+
+void ShardRouter::onShardFinished(int index)
+{
+    Shard &shard = shards[index];
+    shard.lastReportMs = 0;
+    if(stopping)
+        return;
+    Logger::log(Logger::Warning, "Le shard " + QString::number(index) + " s'est arrêté, redémarrage...");
+    QTimer::singleShot(SHARD_RESTART_DELAY_MS, this, [=]() {
+        if(!stopping)
+            startShard(index);
+    });
+}
+
+/*
+ * Retourne -1 si aucun shard n'est disponible. Les clients déjà envoyés
+ * depuis le dernier rapport comptent, sinon un pic de connexions irait
+ * entièrement au même shard. Un shard saturé n'est choisi que si tous
+ * le sont : ses joueurs attendront dans sa file.
+ */
+int ShardRouter::leastLoadedShard() const
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    int best = -1;
+    int bestLoad = 0;
+    for(int i = 0; i < shards.size(); i++) {
+        const Shard &shard = shards.at(i);
+        if(shard.lastReportMs == 0 || now - shard.lastReportMs > SHARD_REPORT_TIMEOUT_MS)
+            continue;
+        const int load = shard.nbClients + shard.nbQueued + shard.redirectedSinceReport;
+        const bool better = best == -1 || (shards.at(best).saturated && !shard.saturated)
+                || (shards.at(best).saturated == shard.saturated && load < bestLoad);
+        if(better) {
+            best = i;
+            bestLoad = load;
+        }
+    }
+    return best;
+}
+
+/*
+ * Le client n'a encore rien envoyé : il reçoit son shard et se reconnecte
+ * lui-même, le routeur n'a aucun état à garder
+ */
+void ShardRouter::onNewClient()
+{
+    while(publicServer->hasPendingConnections()) {
+        QTcpSocket *socket = publicServer->nextPendingConnection();
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        const int index = leastLoadedShard();
+        QJsonObject message;
+        Protocol::MessageId messageId = Protocol::Redirect;
+        if(index == -1) {
+            Logger::log(Logger::Warning, "Aucun shard disponible, client refusé");
+            message[QStringLiteral("success")] = false;
+            message[QStringLiteral("reason")] = QStringLiteral("serverFull");
+            messageId = Protocol::Login;
+        } else {
+            shards[index].redirectedSinceReport++;
+            message[QStringLiteral("port")] = shards.at(index).port;
+        }
+        socket->write(Protocol::frame(Protocol::encode(messageId, message)));
+        socket->disconnectFromHost();
+    }
+}
+
+void ShardRouter::onNewShardSocket()
+{
+    while(loadServer->hasPendingConnections()) {
+        QLocalSocket *socket = loadServer->nextPendingConnection();
+        loadReaders.insert(socket, new FrameReader(MAX_LOAD_FRAME_SIZE));
+        connect(socket, &QLocalSocket::readyRead, this, [=]() { readLoad(socket); });
+        connect(socket, &QLocalSocket::disconnected, this, [=]() {
+            for(int i = 0; i < shards.size(); i++) {
+                if(shards.at(i).socket == socket)
+                    shards[i].socket = nullptr;
+            }
+            delete loadReaders.take(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+/*
+ * Le shard est reconnu par le port annoncé dans ses rapports. Comme pour
+ * les clients, on lit jusqu'à vider le socket : readyRead n'est pas réémis
+ * pour les octets déjà reçus.
+ */
+void ShardRouter::readLoad(QLocalSocket *socket)
+{
+    FrameReader *reader = loadReaders.value(socket);
+    if(reader == nullptr)
+        return;
+    QByteArray payload;
+    do {
+        reader->readFrom(socket);
+        while(reader->nextFrame(&payload)) {
+            int messageId;
+            QJsonObject load;
+            if(!Protocol::decode(payload, &messageId, &load) || messageId != Protocol::ShardLoad)
+                continue;
+            const quint16 port = quint16(load.value(QLatin1String("port")).toInt());
+            for(int i = 0; i < shards.size(); i++) {
+                Shard &shard = shards[i];
+                if(shard.port != port)
+                    continue;
+                shard.socket = socket;
+                shard.nbClients = load.value(QLatin1String("clients")).toInt();
+                shard.nbRooms = load.value(QLatin1String("rooms")).toInt();
+                shard.nbQueued = load.value(QLatin1String("queued")).toInt();
+                shard.saturated = load.value(QLatin1String("saturated")).toBool();
+                shard.redirectedSinceReport = 0;
+                shard.lastReportMs = QDateTime::currentMSecsSinceEpoch();
+                break;
+            }
+        }
+    } while(socket->bytesAvailable() > 0 && !reader->hasError());
+    // Paquet trop grand : ce n'est pas un de nos shards
+    if(reader->hasError()) {
+        Logger::log(Logger::Warning, "Rapport de charge illisible, socket fermée");
+        socket->abort();
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * Description : Cette classe est le routeur du mode multi-processus
+ *               (--router). Elle lance un processus serveur (shard) par
+ *               coeur, chacun avec ses propres parties sur son propre port,
+ *               et écoute le port public. Chaque nouveau client reçoit un
+ *               message redirect vers le shard le moins chargé, puis le
+ *               routeur ferme la connexion : il ne voit passer aucun
+ *               message de jeu. Les shards envoient leur charge chaque
+ *               seconde par une socket locale et sont relancés s'ils
+ *               s'arrêtent.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef SHARDROUTER_H
+#define SHARDROUTER_H
+
+#include "framereader.h"
+#include "serverconfig.h"
+
+#include <QHash>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QObject>
+#include <QProcess>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QVector>
+
+class ShardRouter : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(ShardRouter)
+
+public:
+    ShardRouter(const ServerConfig &config, QObject *parent = nullptr);
+    ~ShardRouter();
+    bool start();
+    void stop();
+
+private:
+    typedef struct Shard_s {
+        int index;
+        quint16 port;
+        QProcess *process;
+        QLocalSocket *socket;       // Rapports de charge, nullptr tant que le shard ne s'est pas annoncé
+        int nbClients;
+        int nbRooms;
+        int nbQueued;
+        bool saturated;             // Le shard refuse les nouvelles parties
+        int redirectedSinceReport;  // Clients envoyés depuis le dernier rapport, pas encore comptés par le shard
+        qint64 lastReportMs;
+    } Shard;
+
+    ServerConfig config;
+    QTcpServer *publicServer;
+    QLocalServer *loadServer;
+    QVector<Shard> shards;
+    QHash<QLocalSocket *, FrameReader *> loadReaders;   // Un par socket de shard, même pas encore annoncé
+    bool stopping;
+
+    QStringList shardArguments(const Shard &shard) const;
+    void startShard(int index);
+    int leastLoadedShard() const;
+    void readLoad(QLocalSocket *socket);
+
+private slots:
+    void onNewClient();
+    void onNewShardSocket();
+    void onShardFinished(int index);
+};
+
+#endif // SHARDROUTER_H
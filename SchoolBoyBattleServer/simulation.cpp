@@ -0,0 +1,450 @@
+/*
+ * Description : Cette classe fait tourner les règles du jeu sur le serveur,
+ *               à pas de temps fixe : déplacement des joueurs selon les
+ *               touches reçues, collisions avec les murs, apparition des
+ *               candies, ramassage, vol et validation. Les clients
+ *               n'envoient que leurs touches et reçoivent l'état calculé ici,
+ *               limité à ce qui est proche de leur joueur.
+ *               Elle garde les positions des derniers pas pour juger les
+ *               contacts vus par un client au pas qu'il avait à l'écran.
+ *               Elle appartient à une partie et vit dans son thread.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "simulation.h"
+#include <QtMath>
+#include <cstdlib>
+
+// Mêmes valeurs que Player et Candy chez le client
+#define PLAYER_WIDTH 130
+#define PLAYER_HEIGHT 150
+#define PLAYER_SPEED 800.0              // Pixels par seconde
+#define FEET_TOP 130                    // La collision ne se fait qu'avec les pieds
+#define FEET_WIDTH_RATIO 0.6
+#define WALL_PROBE_SECONDS 0.05         // Le client teste les murs 3 images à l'avance
+#define CANDY_SIZE 130
+#define CANDY_FOLLOW_RATE 5.0           // Part de la distance rattrapée par seconde
+#define FIRST_CANDY_OFFSET 18           // Le premier candy suit un peu sous le joueur
+#define FIRST_SPAWN_MAX_MS 10000
+#define RESPAWN_RANDOM_MAX_MS 10000
+// La vue du client n'est pas zoomée, on prend un écran 1920x1080
+#define VIEW_HALF_WIDTH 960
+#define VIEW_HALF_HEIGHT 540
+#define INTEREST_MARGIN 260             // Deux tiles, pour qu'un joueur n'apparaisse pas au bord
+#define MAX_REWIND_TICKS 10             // Un client ne peut pas revenir plus de 333 ms en arrière
+#define CLAIM_TOLERANCE 20              // Ecart accepté entre l'affichage du client et le serveur
+
+Simulation::Simulation(const GameMap *map, QObject *parent) :
+    QObject(parent),
+    map(map),
+    tick(0),
+    nowMs(0)
+{
+    scores[0] = 0;
+    scores[1] = 0;
+}
+
+/*
+ * Nouvelle partie : aucun joueur, aucun candy, et chaque emplacement
+ * attend un délai aléatoire avant son premier candy
+ */
+void Simulation::reset()
+{
+    players.clear();
+    candies.clear();
+    candyBodies.clear();
+    const QVector<GameMap::CandyPlacement> &placements = map->getCandyPlacements();
+    nextSpawnMs.resize(placements.size());
+    for(int i = 0; i < placements.size(); i++)
+        nextSpawnMs[i] = placements.at(i).candyType < 0 ? -1 : rand() % (FIRST_SPAWN_MAX_MS + 1);
+    tick = 0;
+    nowMs = 0;
+    scores[0] = 0;
+    scores[1] = 0;
+    for(int i = 0; i < HISTORY_TICKS; i++) {
+        history[i].tick = 0;
+        history[i].candyPos.clear();
+    }
+}
+
+/*
+ * Le joueur apparait au point de son équipe, placé comme chez le client
+ */
+void Simulation::addPlayer(qintptr descriptor, int team)
+{
+    PlayerState player;
+    player.descriptor = descriptor;
+    player.team = team;
+    player.pos = spawnPos(team);
+    for(int i = 0; i < 4; i++)
+        player.moves[i] = false;
+    players.append(player);
+}
+
+/*
+ * Les candies du joueur restent dans sa file, les autres peuvent les voler
+ */
+void Simulation::removePlayer(qintptr descriptor)
+{
+    const int index = findPlayer(descriptor);
+    if(index != -1)
+        players.remove(index);
+}
+
+void Simulation::setInput(qintptr descriptor, int direction, bool pressed)
+{
+    const int index = findPlayer(descriptor);
+    if(index == -1 || direction < Up || direction > Left)
+        return;
+    players[index].moves[direction] = pressed;
+}
+
+int Simulation::findPlayer(qintptr descriptor) const
+{
+    for(int i = 0; i < players.size(); i++) {
+        if(players.at(i).descriptor == descriptor)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * Un pas de simulation. Les joueurs bougent tous avant que les contacts
+ * soient testés, l'ordre des joueurs ne change donc pas les positions.
+ */
+void Simulation::step()
+{
+    const double dt = 1.0 / TICK_RATE;
+    tick++;
+    nowMs = qint64(tick) * 1000 / TICK_RATE;
+
+    spawnCandies();
+    for(int i = 0; i < players.size(); i++)
+        movePlayer(players[i], dt);
+    for(int i = 0; i < players.size(); i++)
+        followPlayer(players.at(i), dt);
+    for(int i = 0; i < players.size(); i++) {
+        touchCandies(players.at(i));
+        validateAtSpawn(players.at(i));
+    }
+    recordHistory();
+}
+
+/*
+ * Le vecteur de la case réutilisée garde sa mémoire, un pas n'alloue
+ * rien tant que le nombre de candies ne grandit pas
+ */
+void Simulation::recordHistory()
+{
+    HistoryFrame &frame = history[tick % HISTORY_TICKS];
+    frame.tick = tick;
+    frame.candyPos.resize(candyBodies.size());
+    for(int i = 0; i < candyBodies.size(); i++)
+        frame.candyPos[i] = candyBodies.at(i).pos;
+}
+
+/*
+ * Le pas que le client avait à l'écran, limité à MAX_REWIND_TICKS en arrière.
+ * nullptr si ce pas n'est plus (ou pas encore) dans l'historique.
+ */
+const Simulation::HistoryFrame *Simulation::historyAt(quint32 seenTick) const
+{
+    if(seenTick > tick)
+        return nullptr;
+    if(tick - seenTick > MAX_REWIND_TICKS)
+        seenTick = tick - MAX_REWIND_TICKS;
+    const HistoryFrame &frame = history[seenTick % HISTORY_TICKS];
+    return frame.tick == seenTick ? &frame : nullptr;
+}
+
+/*
+ * Le client a vu son joueur toucher un candy. Son joueur est déjà à jour
+ * chez le serveur (ses touches arrivent avant sa demande), mais les autres
+ * joueurs et leurs candies étaient affichés avec du retard : on regarde
+ * où était le candy au pas que le client voyait, puis on ramasse ou on vole
+ * comme si le contact avait été détecté ici.
+ * La génération refuse la demande si le candy a changé de propriétaire
+ * depuis ce que le client a vu.
+ */
+bool Simulation::claimCandy(qintptr descriptor, int candyId, quint32 generation, quint32 seenTick)
+{
+    const int index = findPlayer(descriptor);
+    if(index == -1 || candyId < 0 || candyId >= candyBodies.size())
+        return false;
+    if(candies.getGeneration(candyId) != generation)
+        return false;
+
+    const HistoryFrame *frame = historyAt(seenTick);
+    QPointF candyPos = candyBodies.at(candyId).pos;
+    if(frame != nullptr && candyId < frame->candyPos.size())
+        candyPos = frame->candyPos.at(candyId);
+    const QRectF feet = feetRect(players.at(index).pos).adjusted(-CLAIM_TOLERANCE, -CLAIM_TOLERANCE, CLAIM_TOLERANCE, CLAIM_TOLERANCE);
+    if(!feet.intersects(candyRect(candyPos)))
+        return false;
+
+    if(candies.getState(candyId) == CandyRegistry::Free)
+        return takeCandy(players.at(index), candyId, generation);
+    return stealCandies(players.at(index), candyId, generation);
+}
+
+quint32 Simulation::getTick() const
+{
+    return tick;
+}
+
+int Simulation::getScore(int team) const
+{
+    return team == 0 || team == 1 ? scores[team] : 0;
+}
+
+bool Simulation::getPlayerFeet(qintptr descriptor, QPointF *feet) const
+{
+    const int index = findPlayer(descriptor);
+    if(index == -1)
+        return false;
+    *feet = feetRect(players.at(index).pos).center();
+    return true;
+}
+
+int Simulation::getNbCarried(qintptr descriptor) const
+{
+    int nbCandies = 0;
+    for(int candyId = candies.getNewest(descriptor); candyId != -1; candyId = candies.getOlder(candyId))
+        nbCandies++;
+    return nbCandies;
+}
+
+/*
+ * Candy le plus proche que le joueur peut prendre : libre, ou dans la file
+ * d'un joueur de l'autre équipe
+ */
+bool Simulation::nearestCandy(qintptr descriptor, const QPointF &from, QPointF *candy) const
+{
+    const int index = findPlayer(descriptor);
+    if(index == -1)
+        return false;
+    double bestDistance = -1;
+    for(int candyId = 0; candyId < candyBodies.size(); candyId++) {
+        const CandyRegistry::State state = candies.getState(candyId);
+        if(state == CandyRegistry::Held) {
+            const int ownerIndex = findPlayer(candies.getOwner(candyId));
+            if(ownerIndex == -1 || ownerIndex == index || players.at(ownerIndex).team == players.at(index).team)
+                continue;
+        } else if(state != CandyRegistry::Free)
+            continue;
+        const QPointF center = candyRect(candyBodies.at(candyId).pos).center();
+        const double distance = QPointF::dotProduct(center - from, center - from);
+        if(bestDistance < 0 || distance < bestDistance) {
+            bestDistance = distance;
+            *candy = center;
+        }
+    }
+    return bestDistance >= 0;
+}
+
+QPointF Simulation::getBaseFeet(int team) const
+{
+    return feetRect(spawnPos(team)).center();
+}
+
+/*
+ * La vue du client est centrée sur son joueur
+ */
+QRectF Simulation::getInterestRegion(qintptr descriptor) const
+{
+    const int index = findPlayer(descriptor);
+    if(index == -1)
+        return QRectF();
+    const QPointF center = players.at(index).pos + QPointF(PLAYER_WIDTH / 2, PLAYER_HEIGHT / 2);
+    return QRectF(center.x() - VIEW_HALF_WIDTH - INTEREST_MARGIN, center.y() - VIEW_HALF_HEIGHT - INTEREST_MARGIN,
+                  2 * (VIEW_HALF_WIDTH + INTEREST_MARGIN), 2 * (VIEW_HALF_HEIGHT + INTEREST_MARGIN));
+}
+
+/*
+ * Est-ce que le joueur target peut apparaître chez le client de viewer.
+ * Un client sans joueur voit tout.
+ */
+bool Simulation::isOfInterest(qintptr viewer, qintptr target) const
+{
+    if(viewer == target)
+        return true;
+    const QRectF region = getInterestRegion(viewer);
+    const int index = findPlayer(target);
+    if(region.isNull() || index == -1)
+        return true;
+    return region.intersects(playerRect(players.at(index).pos));
+}
+
+/*
+ * Position de chaque joueur, arrondie au pixel, et ses touches appuyées.
+ * Les joueurs loin de viewer ne sont ajoutés qu'avec withFarPlayers : le
+ * client les voit à un rythme réduit, et continue de les déplacer avec
+ * leurs touches entre deux snapshots.
+ */
+QVector<Simulation::EntityState> Simulation::visiblePlayers(qintptr viewer, bool withFarPlayers) const
+{
+    const QRectF region = getInterestRegion(viewer);
+    QVector<EntityState> visible;
+    visible.reserve(players.size());
+    for(int i = 0; i < players.size(); i++) {
+        const PlayerState &player = players.at(i);
+        if(!withFarPlayers && !region.isNull() && player.descriptor != viewer
+                && !region.intersects(playerRect(player.pos)))
+            continue;
+        int moves = 0;
+        for(int direction = Up; direction <= Left; direction++)
+            moves |= int(player.moves[direction]) << direction;
+        visible.append(EntityState{player.descriptor, qRound(player.pos.x()), qRound(player.pos.y()), moves});
+    }
+    return visible;
+}
+
+void Simulation::spawnCandies()
+{
+    const QVector<GameMap::CandyPlacement> &placements = map->getCandyPlacements();
+    for(int i = 0; i < placements.size(); i++) {
+        if(nextSpawnMs.at(i) < 0 || nextSpawnMs.at(i) > nowMs)
+            continue;
+        nextSpawnMs[i] = -1;
+        // L'id du candy est sa place dans candyBodies
+        const int candyId = candyBodies.size();
+        if(!candies.spawn(candyId, placements.at(i).nbPoints))
+            continue;
+        candyBodies.append(CandyBody{placements.at(i).pos, i});
+        emit candySpawned(candyId, i);
+    }
+}
+
+/*
+ * Même réponse aux murs que Player::calculateAnswerVector : on teste un peu
+ * devant le joueur, et on annule le mouvement sur l'axe qui touche un mur
+ */
+void Simulation::movePlayer(PlayerState &player, double dt)
+{
+    QPointF direction(int(player.moves[Right]) - int(player.moves[Left]),
+                      int(player.moves[Down]) - int(player.moves[Up]));
+    if(direction.isNull())
+        return;
+    direction /= qSqrt(QPointF::dotProduct(direction, direction));
+
+    QPointF movement = direction * PLAYER_SPEED * dt;
+    const QPointF probe = direction * PLAYER_SPEED * WALL_PROBE_SECONDS;
+    if(map->collidesWithWall(feetRect(player.pos + probe))) {
+        if(map->collidesWithWall(feetRect(player.pos + QPointF(probe.x(), 0))))
+            movement.setX(0);
+        if(map->collidesWithWall(feetRect(player.pos + QPointF(0, probe.y()))))
+            movement.setY(0);
+    }
+    player.pos += movement;
+}
+
+/*
+ * Chaque candy de la file suit celui qui le précède, le premier suit le joueur
+ */
+void Simulation::followPlayer(const PlayerState &player, double dt)
+{
+    const double factor = qMin(1.0, CANDY_FOLLOW_RATE * dt);
+    QPointF target = player.pos + QPointF(0, FIRST_CANDY_OFFSET);
+    for(int candyId = candies.getNewest(player.descriptor); candyId != -1; candyId = candies.getOlder(candyId)) {
+        QPointF &pos = candyBodies[candyId].pos;
+        pos += (target - pos) * factor;
+        target = pos;
+    }
+}
+
+/*
+ * Le joueur ramasse les candies libres qu'il touche et vole les candies
+ * d'un adversaire qu'il touche
+ */
+void Simulation::touchCandies(const PlayerState &player)
+{
+    const QRectF feet = feetRect(player.pos);
+    for(int candyId = 0; candyId < candyBodies.size(); candyId++) {
+        const CandyRegistry::State state = candies.getState(candyId);
+        if(state != CandyRegistry::Free && state != CandyRegistry::Held)
+            continue;
+        if(!feet.intersects(candyRect(candyBodies.at(candyId).pos)))
+            continue;
+
+        if(state == CandyRegistry::Free)
+            takeCandy(player, candyId, candies.getGeneration(candyId));
+        else
+            stealCandies(player, candyId, candies.getGeneration(candyId));
+    }
+}
+
+bool Simulation::takeCandy(const PlayerState &player, int candyId, quint32 generation)
+{
+    quint32 newGeneration;
+    if(!candies.claim(candyId, generation, player.descriptor, &newGeneration))
+        return false;
+    // L'emplacement attend avant de refaire apparaître un candy
+    const int placementId = candyBodies.at(candyId).placementId;
+    nextSpawnMs[placementId] = nowMs + map->getCandyPlacements().at(placementId).respawnDelayMs
+            + rand() % (RESPAWN_RANDOM_MAX_MS + 1);
+    emit candyTaken(player.descriptor, candyId, newGeneration);
+    return true;
+}
+
+/*
+ * On ne vole pas ses propres candies ni ceux de son équipe
+ */
+bool Simulation::stealCandies(const PlayerState &player, int candyId, quint32 generation)
+{
+    const qintptr owner = candies.getOwner(candyId);
+    if(owner == player.descriptor)
+        return false;
+    const int ownerIndex = findPlayer(owner);
+    if(ownerIndex != -1 && players.at(ownerIndex).team == player.team)
+        return false;
+    quint32 newGeneration;
+    if(candies.steal(candyId, generation, player.descriptor, nowMs, &newGeneration) <= 0)
+        return false;
+    emit candiesStolen(player.descriptor, candyId, newGeneration);
+    return true;
+}
+
+void Simulation::validateAtSpawn(const PlayerState &player)
+{
+    if(candies.getNewest(player.descriptor) == -1)
+        return;
+    if(!map->isInTeamSpawn(feetRect(player.pos), player.team))
+        return;
+    int nbCandies;
+    const int nbPoints = candies.validate(player.descriptor, &nbCandies);
+    scores[player.team] += nbPoints;
+    emit candiesValidated(player.descriptor, nbCandies, nbPoints);
+}
+
+/*
+ * Position du joueur à son apparition, placé comme chez le client
+ */
+QPointF Simulation::spawnPos(int team) const
+{
+    return map->getTeamSpawnpoint(team)
+            - QPointF(0, map->getTileSize() / 2 + (PLAYER_HEIGHT - map->getTileSize()));
+}
+
+QRectF Simulation::playerRect(const QPointF &pos)
+{
+    return QRectF(pos, QSizeF(PLAYER_WIDTH, PLAYER_HEIGHT));
+}
+
+/*
+ * Rectangle de collision du joueur, comme Player::shape
+ */
+QRectF Simulation::feetRect(const QPointF &pos)
+{
+    return QRectF(pos.x() + (1 - FEET_WIDTH_RATIO) * PLAYER_WIDTH / 2, pos.y() + FEET_TOP,
+                  PLAYER_WIDTH * FEET_WIDTH_RATIO, PLAYER_HEIGHT - FEET_TOP);
+}
+
+/*
+ * Rectangle de collision d'un candy, comme Candy::shape
+ */
+QRectF Simulation::candyRect(const QPointF &pos)
+{
+    return QRectF(pos.x() + CANDY_SIZE / 4.0, pos.y() + CANDY_SIZE / 4.0, CANDY_SIZE / 2.0, CANDY_SIZE / 2.0);
+}
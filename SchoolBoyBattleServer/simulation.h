@@ -0,0 +1,120 @@
+/*
+ * Description : Cette classe fait tourner les règles du jeu sur le serveur,
+ *               à pas de temps fixe : déplacement des joueurs selon les
+ *               touches reçues, collisions avec les murs, apparition des
+ *               candies, ramassage, vol et validation. Les clients
+ *               n'envoient que leurs touches et reçoivent l'état calculé ici,
+ *               limité à ce qui est proche de leur joueur.
+ *               Elle garde les positions des derniers pas pour juger les
+ *               contacts vus par un client au pas qu'il avait à l'écran.
+ *               Elle appartient à une partie et vit dans son thread.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "candyregistry.h"
+#include "gamemap.h"
+
+#include <QObject>
+#include <QPointF>
+#include <QRectF>
+#include <QVector>
+
+#define TICK_RATE 30            // Pas de simulation par seconde
+#define HISTORY_TICKS 16        // Pas gardés pour revenir en arrière, un peu plus d'une demi-seconde
+
+class Simulation : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(Simulation)
+
+public:
+    enum Direction : int {Up = 0, Right = 1, Down = 2, Left = 3};
+
+    // Etat d'un joueur tel qu'il est envoyé aux clients
+    typedef struct EntityState_s {
+        qintptr descriptor;
+        int x;
+        int y;
+        int moves;              // Un bit par Direction
+    } EntityState;
+
+    Simulation(const GameMap *map, QObject *parent = nullptr);
+    void reset();
+    void addPlayer(qintptr descriptor, int team);
+    void removePlayer(qintptr descriptor);
+    void setInput(qintptr descriptor, int direction, bool pressed);
+    // Contact avec un candy vu par le client au pas seenTick
+    bool claimCandy(qintptr descriptor, int candyId, quint32 generation, quint32 seenTick);
+    void step();
+
+    quint32 getTick() const;
+    int getScore(int team) const;
+    // Zone que le client du joueur peut voir, marge comprise
+    QRectF getInterestRegion(qintptr descriptor) const;
+    bool isOfInterest(qintptr viewer, qintptr target) const;
+    QVector<EntityState> visiblePlayers(qintptr viewer, bool withFarPlayers) const;
+
+    // Ce que les bots savent de la partie, en centres des pieds
+    bool getPlayerFeet(qintptr descriptor, QPointF *feet) const;
+    int getNbCarried(qintptr descriptor) const;
+    bool nearestCandy(qintptr descriptor, const QPointF &from, QPointF *candy) const;
+    QPointF getBaseFeet(int team) const;
+
+private:
+    typedef struct PlayerState_s {
+        qintptr descriptor;
+        int team;
+        QPointF pos;
+        bool moves[4];
+    } PlayerState;
+
+    typedef struct CandyBody_s {
+        QPointF pos;
+        int placementId;
+    } CandyBody;
+
+    // Positions des candies à la fin d'un pas, indexées comme candyBodies.
+    // Les candies suivent les joueurs, ce sont eux qui sont affichés en retard.
+    typedef struct HistoryFrame_s {
+        quint32 tick;
+        QVector<QPointF> candyPos;
+    } HistoryFrame;
+
+    const GameMap *map;
+    QVector<PlayerState> players;
+    CandyRegistry candies;
+    QVector<CandyBody> candyBodies;     // Indexé par id de candy
+    QVector<qint64> nextSpawnMs;        // Par emplacement, -1 si un candy y est posé
+    HistoryFrame history[HISTORY_TICKS];    // Indexé par tick % HISTORY_TICKS
+    quint32 tick;
+    qint64 nowMs;
+    int scores[2];              // Points validés par équipe
+
+    int findPlayer(qintptr descriptor) const;
+    QPointF spawnPos(int team) const;
+    void spawnCandies();
+    void movePlayer(PlayerState &player, double dt);
+    void followPlayer(const PlayerState &player, double dt);
+    void touchCandies(const PlayerState &player);
+    bool takeCandy(const PlayerState &player, int candyId, quint32 generation);
+    bool stealCandies(const PlayerState &player, int candyId, quint32 generation);
+    void recordHistory();
+    const HistoryFrame *historyAt(quint32 seenTick) const;
+    void validateAtSpawn(const PlayerState &player);
+    static QRectF playerRect(const QPointF &pos);
+    static QRectF feetRect(const QPointF &pos);
+    static QRectF candyRect(const QPointF &pos);
+
+signals:
+    void candySpawned(int candyId, int placementId);
+    void candyTaken(qintptr descriptor, int candyId, quint32 generation);
+    void candiesStolen(qintptr descriptor, int candyIdStartingFrom, quint32 generation);
+    void candiesValidated(qintptr descriptor, int nbCandies, int nbPoints);
+};
+
+#endif // SIMULATION_H
@@ -0,0 +1,107 @@
+/*
+ * Description : Cette classe encode les snapshots d'un client par rapport
+ *               au dernier snapshot qu'il a confirmé (sa base) : seuls les
+ *               joueurs et les champs qui ont changé depuis sont envoyés,
+ *               avec un masque des champs présents. Elle garde l'état connu
+ *               du client pour chacun des derniers snapshots envoyés.
+ *               Une instance par client, utilisée dans le thread de la partie.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "snapshotencoder.h"
+#include <QJsonArray>
+
+SnapshotEncoder::SnapshotEncoder() :
+    ackedTick(0),
+    hasAck(false)
+{
+    reset();
+}
+
+/*
+ * Nouvelle partie : le prochain snapshot sera complet
+ */
+void SnapshotEncoder::reset()
+{
+    for(int i = 0; i < SNAPSHOT_HISTORY; i++) {
+        baselines[i].tick = 0;
+        baselines[i].valid = false;
+        baselines[i].entities.clear();
+    }
+    ackedTick = 0;
+    hasAck = false;
+}
+
+/*
+ * Le client a reçu le snapshot du pas tick. Une confirmation plus ancienne
+ * que la base actuelle, ou d'un snapshot qu'on n'a pas envoyé, est ignorée.
+ */
+void SnapshotEncoder::acknowledge(quint32 tick)
+{
+    if(hasAck && tick <= ackedTick)
+        return;
+    if(baselineFor(tick) == nullptr)
+        return;
+    ackedTick = tick;
+    hasAck = true;
+}
+
+/*
+ * nullptr si le snapshot de ce pas n'est plus gardé
+ */
+const SnapshotEncoder::Baseline *SnapshotEncoder::baselineFor(quint32 tick) const
+{
+    const Baseline &baseline = baselines[tick % SNAPSHOT_HISTORY];
+    return baseline.valid && baseline.tick == tick ? &baseline : nullptr;
+}
+
+/*
+ * Chaque joueur est envoyé comme [masque, valeurs des champs du masque...],
+ * un joueur qui n'a pas changé depuis la base n'est pas envoyé du tout.
+ * Sans base confirmée encore gardée, le snapshot est complet (pas de "base").
+ */
+QJsonObject SnapshotEncoder::encode(quint32 tick, const QVector<Simulation::EntityState> &entities)
+{
+    const Baseline *base = hasAck ? baselineFor(ackedTick) : nullptr;
+    // La base va être remplacée si elle est dans la même case
+    QHash<qintptr, Simulation::EntityState> known;
+    if(base != nullptr)
+        known = base->entities;
+
+    QJsonObject players;
+    for(int i = 0; i < entities.size(); i++) {
+        const Simulation::EntityState &entity = entities.at(i);
+        int mask = Protocol::AllFields;
+        if(base != nullptr && known.contains(entity.descriptor)) {
+            const Simulation::EntityState &previous = known.value(entity.descriptor);
+            mask = 0;
+            if(entity.x != previous.x) mask |= Protocol::FieldX;
+            if(entity.y != previous.y) mask |= Protocol::FieldY;
+            if(entity.moves != previous.moves) mask |= Protocol::FieldMoves;
+        }
+        known.insert(entity.descriptor, entity);
+        if(mask == 0)
+            continue;
+
+        QJsonArray fields;
+        fields.append(mask);
+        if(mask & Protocol::FieldX) fields.append(entity.x);
+        if(mask & Protocol::FieldY) fields.append(entity.y);
+        if(mask & Protocol::FieldMoves) fields.append(entity.moves);
+        players.insert(QString::number(entity.descriptor), fields);
+    }
+
+    Baseline &baseline = baselines[tick % SNAPSHOT_HISTORY];
+    baseline.tick = tick;
+    baseline.valid = true;
+    baseline.entities = known;
+
+    QJsonObject message;
+    message.insert("tick", qint64(tick));
+    if(base != nullptr)
+        message.insert("base", qint64(ackedTick));
+    message.insert("players", players);
+    return message;
+}
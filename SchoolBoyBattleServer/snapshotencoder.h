@@ -0,0 +1,46 @@
+/*
+ * Description : Cette classe encode les snapshots d'un client par rapport
+ *               au dernier snapshot qu'il a confirmé (sa base) : seuls les
+ *               joueurs et les champs qui ont changé depuis sont envoyés,
+ *               avec un masque des champs présents. Elle garde l'état connu
+ *               du client pour chacun des derniers snapshots envoyés.
+ *               Une instance par client, utilisée dans le thread de la partie.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef SNAPSHOTENCODER_H
+#define SNAPSHOTENCODER_H
+
+#include "protocol.h"
+#include "simulation.h"
+
+#include <QHash>
+#include <QJsonObject>
+#include <QVector>
+
+class SnapshotEncoder
+{
+public:
+    SnapshotEncoder();
+    void reset();
+    void acknowledge(quint32 tick);
+    QJsonObject encode(quint32 tick, const QVector<Simulation::EntityState> &entities);
+
+private:
+    // Etat du client une fois le snapshot du pas tick reçu
+    typedef struct Baseline_s {
+        quint32 tick;
+        bool valid;
+        QHash<qintptr, Simulation::EntityState> entities;
+    } Baseline;
+
+    Baseline baselines[SNAPSHOT_HISTORY];   // Indexé par tick % SNAPSHOT_HISTORY
+    quint32 ackedTick;
+    bool hasAck;
+
+    const Baseline *baselineFor(quint32 tick) const;
+};
+
+#endif // SNAPSHOTENCODER_H
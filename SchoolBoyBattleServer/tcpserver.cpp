@@ -2,29 +2,64 @@
  * Description : Cette classe s'occupe de tous les clients connectés au serveur.
  *               Lorsqu’un utilisateur se connecte, elle créé un objet ServerWorker,
  *               lui assigne un thread et en garde une référence dans un de ses membres.
- *               Elle permet de centraliser le traitement des données reçues par
- *               les différents clients et offre des fonctions utiles pour envoyer
- *               des messages comme un broadcast, envoyer un paquet à tous les clients
- *               l’envoyeur inclus, etc.
+ *               Au login, le client entre dans la file du Matchmaker avec la
+ *               taille de partie qu'il préfère. Plusieurs fois par seconde,
+ *               les clients en attente sont placés par groupes dans les
+ *               parties (Room) en salle d'attente, ou dans de nouvelles
+ *               parties. Une partie qui attend trop longtemps est complétée
+ *               avec des bots. Chaque partie est liée à un thread et le
+ *               client y est déplacé : ses messages sont ensuite traités par
+ *               sa partie, dans ce thread.
  * Version     : 1.0.0
  * Date        : 25.01.2021
  * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
 */
 
 #include "tcpserver.h"
-#include <QJsonArray>
-#include <QJsonDocument>
+#include "metrics.h"
+#include <QElapsedTimer>
 #include <QJsonObject>
 #include <QTimer>
+#include <algorithm>
 
-TcpServer::TcpServer(QObject *parent) :
+// Intervalle entre deux relevés des files d'envoi des clients
+#define QUEUE_STATS_INTERVAL_MS 10000
+// Nombre maximum de parties hébergées en même temps
+#define MAX_ROOMS 500
+#define MATCHMAKING_INTERVAL_MS 250
+// Une partie est créée sans attendre d'avoir tous ses joueurs au-delà
+#define MAX_QUEUE_WAIT_MS 3000
+// Une partie en salle d'attente depuis plus longtemps est complétée avec des bots
+#define BACKFILL_AFTER_MS 20000
+// Le même terrain que le client
+#define MAP_FILE ":/maps/mediumTerrain.tmx"
+
+TcpServer::TcpServer(int threadCount, const QString &recordDir, int botsPerRoom, QObject *parent) :
     QTcpServer(parent),
-    gameStarted(false),
-    idealThreadCount(qMax(QThread::idealThreadCount(), 1)),
-    nbUsersConnected(0)
+    idealThreadCount(threadCount > 0 ? threadCount : qMax(QThread::idealThreadCount(), 1)),
+    botsPerRoom(botsPerRoom),
+    nextRoomId(0),
+    nbConnectionsTotal(0),
+    queueStatsTimer(new QTimer(this)),
+    matchmakingTimer(new QTimer(this)),
+    nbBackfilledRooms(0),
+    refusingRooms(false),
+    nbRefusedRooms(0),
+    recordWriter(nullptr)
 {
+    // Un seul thread d'écriture pour les enregistrements de toutes les parties
+    if(!recordDir.isEmpty()) {
+        recordWriter = new RecordWriter(recordDir, this);
+        recordWriter->start(QThread::LowPriority);
+    }
     availableThreads.reserve(idealThreadCount);
     threadsLoaded.reserve(idealThreadCount);
+    connect(queueStatsTimer, &QTimer::timeout, this, &TcpServer::logQueueStats);
+    queueStatsTimer->start(QUEUE_STATS_INTERVAL_MS);
+    connect(matchmakingTimer, &QTimer::timeout, this, &TcpServer::matchmake);
+    matchmakingTimer->start(MATCHMAKING_INTERVAL_MS);
+    matchmakingClock.start();
+    gameMap.load(MAP_FILE);
 }
 
 TcpServer::~TcpServer() {
@@ -32,6 +67,9 @@ TcpServer::~TcpServer() {
         availableThreads.at(i)->quit();
         availableThreads.at(i)->wait();
     }
+    // Les parties ont fermé leurs fichiers en étant supprimées avec leur thread
+    if(recordWriter)
+        recordWriter->stop();
 }
 
 void TcpServer::incomingConnection(qintptr socketDescriptor) {
@@ -41,95 +79,219 @@ void TcpServer::incomingConnection(qintptr socketDescriptor) {
         return;
     }
 
-    int threadIdx = availableThreads.size();
+    // En attendant le login, le client est dans le thread le moins chargé
+    const int threadIdx = leastLoadedThread();
+    threadsLoaded[threadIdx]++;
+    clientThreads.insert(worker, threadIdx);
+    worker->moveToThread(availableThreads.at(threadIdx));
+
+    connect(availableThreads.at(threadIdx), &QThread::finished, worker, &QObject::deleteLater);
+    connect(worker, &ServerWorker::disconnectedFromClient, this, std::bind(&TcpServer::userDisconnected, this, worker));
+    connect(worker, &ServerWorker::error, this, std::bind(&TcpServer::userError, this, worker));
+    connect(worker, &ServerWorker::messageReceived, this, std::bind(&TcpServer::messageReceived, this, worker, std::placeholders::_1, std::placeholders::_2));
+    connect(this, &TcpServer::stopAllClients, worker, &ServerWorker::disconnectFromClient);
+    clients.append(worker);
+    nbConnectionsTotal++;
+    Logger::log(Logger::Info, "Nouveau client connecté");
+}
 
-    if(threadIdx < idealThreadCount) {
+/*
+ * Les threads sont créés au fur et à mesure jusqu'à idealThreadCount,
+ * ensuite on prend celui qui a le moins de clients
+ */
+int TcpServer::leastLoadedThread() {
+    if(availableThreads.size() < idealThreadCount) {
         availableThreads.append(new QThread);
-        threadsLoaded.append(1);
+        threadsLoaded.append(0);
         availableThreads.last()->start();
-    } else {
-        // Trouver le thread avec le moins de clients et l'utiliser
-        threadIdx = std::distance(threadsLoaded.cbegin(), std::min_element(threadsLoaded.cbegin(), threadsLoaded.cend()));
-        threadsLoaded[threadIdx]++;
+        return availableThreads.size() - 1;
     }
+    return std::distance(threadsLoaded.cbegin(), std::min_element(threadsLoaded.cbegin(), threadsLoaded.cend()));
+}
 
-    worker->moveToThread(availableThreads.at(threadIdx));
+/*
+ * Thread le moins chargé dont aucune partie n'est saturée, -1 s'il n'y en
+ * a pas. Le niveau des parties est atomique, on peut le lire d'ici.
+ */
+int TcpServer::unsaturatedThread() const {
+    QVector<bool> saturated(availableThreads.size(), false);
+    for (QHash<Room *, int>::const_iterator i = roomThreads.constBegin(); i != roomThreads.constEnd(); ++i) {
+        if (i.key()->getLoadLevel() >= Room::LoadSaturated)
+            saturated[i.value()] = true;
+    }
+    int best = -1;
+    for (int i = 0; i < availableThreads.size(); i++) {
+        if (!saturated.at(i) && (best == -1 || threadsLoaded.at(i) < threadsLoaded.at(best)))
+            best = i;
+    }
+    return best;
+}
 
-    // Si la partie a déjà commencé
-    if (gameStarted) {
-        QJsonObject message;
-        message[QStringLiteral("type")] = QStringLiteral("login");
-        message[QStringLiteral("success")] = false;
-        message[QStringLiteral("reason")] = QStringLiteral("gameAlreadyStarted");
-        sendJson(worker, message);
-        worker->deleteLater();
+/*
+ * Le dernier niveau de délestage : plus aucune nouvelle partie. Les
+ * joueurs restent dans la file et le routeur envoie les nouveaux ailleurs.
+ */
+bool TcpServer::isSaturated() const {
+    return availableThreads.size() >= idealThreadCount && unsaturatedThread() == -1;
+}
+
+/*
+ * Relevé de la taille des files d'envoi. Les compteurs des workers sont
+ * atomiques, on peut les lire depuis ce thread.
+ */
+void TcpServer::logQueueStats() {
+    int totalPackets = 0;
+    int totalBytes = 0;
+    int maxBytes = 0;
+    quint64 totalDropped = 0;
+    for(int i = 0; i < clients.length(); i++) {
+        totalPackets += clients.at(i)->getQueuedPackets();
+        totalBytes += clients.at(i)->getQueuedBytes();
+        maxBytes = qMax(maxBytes, clients.at(i)->getQueuedBytes());
+        totalDropped += clients.at(i)->getDroppedPackets();
+    }
+    // Rien à signaler tant qu'aucun client n'est ralenti
+    const int level = totalPackets > 0 ? Logger::Info : Logger::Debug;
+    if(!Logger::isEnabled(level) || clients.isEmpty())
         return;
+    Logger::log(level, "Files d'envoi : " + QString::number(totalPackets) + " paquets, "
+                + QString::number(totalBytes) + " octets (max " + QString::number(maxBytes) + " par client), "
+                + QString::number(totalDropped) + " paquets fusionnés ou supprimés");
+}
+
+/*
+ * Les valeurs de ce thread (connexions, parties, files d'envoi) sont lues
+ * directement, les compteurs par type de message viennent de Metrics
+ */
+QString TcpServer::renderMetrics() const
+{
+    int nbStartedRooms = 0;
+    int nbRoomsPerLevel[Room::NbLoadLevels] = {};
+    qint64 maxTickCostNs = 0;
+    QString overloadedRooms;
+    for (const Room *room : rooms) {
+        if (room->isStarted())
+            nbStartedRooms++;
+        const int level = room->getLoadLevel();
+        nbRoomsPerLevel[level]++;
+        maxTickCostNs = qMax(maxTickCostNs, room->getTickCostNs());
+        // Seulement les parties délestées, pour ne pas écrire une ligne par partie
+        if (level > Room::LoadNormal)
+            overloadedRooms += "sbb_room_load_level{room=\"" + QString::number(room->getId()) + "\"} " + QString::number(level) + '\n';
+    }
+    qint64 queuedPackets = 0;
+    qint64 queuedBytes = 0;
+    int maxQueuedBytes = 0;
+    qint64 rttSumMs = 0;
+    int nbRtt = 0;
+    int maxRttMs = 0;
+    for (const ServerWorker *client : clients) {
+        queuedPackets += client->getQueuedPackets();
+        queuedBytes += client->getQueuedBytes();
+        maxQueuedBytes = qMax(maxQueuedBytes, client->getQueuedBytes());
+        const int rttMs = client->getRttMs();
+        if (rttMs >= 0) {
+            rttSumMs += rttMs;
+            nbRtt++;
+            maxRttMs = qMax(maxRttMs, rttMs);
+        }
     }
 
-    connect(availableThreads.at(threadIdx), &QThread::finished, worker, &QObject::deleteLater);
-    connect(worker, &ServerWorker::disconnectedFromClient, this, std::bind(&TcpServer::userDisconnected, this, worker, threadIdx));
-    connect(worker, &ServerWorker::error, this, std::bind(&TcpServer::userError, this, worker));
-    connect(worker, &ServerWorker::jsonRecieved, this, std::bind(&TcpServer::jsonReceived, this, worker, std::placeholders::_1));
-    connect(worker, &ServerWorker::logMessage, this, &TcpServer::logMessage);
-    connect(this, &TcpServer::stopAllClients, worker, &ServerWorker::disconnectFromClient);
-    clients.append(worker);
-    emit logMessage("Nouveau client connecté");
+    QString text;
+    text += "# TYPE sbb_connections gauge\n";
+    text += "sbb_connections " + QString::number(clients.length()) + '\n';
+    text += "# TYPE sbb_connections_total counter\n";
+    text += "sbb_connections_total " + QString::number(nbConnectionsTotal) + '\n';
+    text += "# TYPE sbb_logged_in_clients gauge\n";
+    text += "sbb_logged_in_clients " + QString::number(clientRooms.size()) + '\n';
+    text += "# TYPE sbb_rooms gauge\n";
+    text += "sbb_rooms{state=\"waiting\"} " + QString::number(rooms.length() - nbStartedRooms) + '\n';
+    text += "sbb_rooms{state=\"started\"} " + QString::number(nbStartedRooms) + '\n';
+    text += "# TYPE sbb_rooms_by_load_level gauge\n";
+    for (int i = 0; i < Room::NbLoadLevels; i++)
+        text += "sbb_rooms_by_load_level{level=\"" + QString::number(i) + "\"} " + QString::number(nbRoomsPerLevel[i]) + '\n';
+    text += "# TYPE sbb_room_load_level gauge\n";
+    text += overloadedRooms;
+    text += "# TYPE sbb_room_tick_max_seconds gauge\n";
+    text += "sbb_room_tick_max_seconds " + QString::number(maxTickCostNs / 1e9) + '\n';
+    text += "# TYPE sbb_rooms_created_total counter\n";
+    text += "sbb_rooms_created_total " + QString::number(nextRoomId) + '\n';
+    text += "# TYPE sbb_rooms_backfilled_total counter\n";
+    text += "sbb_rooms_backfilled_total " + QString::number(nbBackfilledRooms) + '\n';
+    text += "# TYPE sbb_rooms_refused_total counter\n";
+    text += "sbb_rooms_refused_total " + QString::number(nbRefusedRooms) + '\n';
+    text += "# TYPE sbb_matchmaking_queue gauge\n";
+    text += "sbb_matchmaking_queue " + QString::number(matchmaker.size()) + '\n';
+    text += "# TYPE sbb_send_queue_packets gauge\n";
+    text += "sbb_send_queue_packets " + QString::number(queuedPackets) + '\n';
+    text += "# TYPE sbb_send_queue_bytes gauge\n";
+    text += "sbb_send_queue_bytes " + QString::number(queuedBytes) + '\n';
+    text += "# TYPE sbb_send_queue_max_client_bytes gauge\n";
+    text += "sbb_send_queue_max_client_bytes " + QString::number(maxQueuedBytes) + '\n';
+    text += "# TYPE sbb_client_rtt_seconds gauge\n";
+    text += "sbb_client_rtt_seconds{stat=\"mean\"} " + QString::number(nbRtt == 0 ? 0.0 : rttSumMs / 1000.0 / nbRtt) + '\n';
+    text += "sbb_client_rtt_seconds{stat=\"max\"} " + QString::number(maxRttMs / 1000.0) + '\n';
+    return text + Metrics::render();
 }
 
-void TcpServer::sendJson(ServerWorker *destination, const QJsonObject &message)
+int TcpServer::getNbClients() const
 {
-    Q_ASSERT(destination);
-    // Faire un qtimer avec un temps de 0 exécutera le code au prochain
-    // instant de processeur disponible
-    QTimer::singleShot(0, destination, std::bind(&ServerWorker::sendJson, destination, message));
+    return clients.length();
 }
 
-void TcpServer::broadcast(const QJsonObject &message, ServerWorker *exclude) {
-    for (int i = 0; i < clients.length(); i++) {
-        Q_ASSERT(clients.at(i));
-        if (clients.at(i) == exclude)
-            continue;
-        sendJson(clients.at(i), message);
-    }
+int TcpServer::getNbRooms() const
+{
+    return rooms.length();
 }
 
-void TcpServer::sendEveryone(const QJsonObject &message) {
-    for(int i = 0; i < clients.length(); i++) {
-        Q_ASSERT(clients.at(i));
-        sendJson(clients.at(i), message);
-    }
+int TcpServer::getNbQueued() const
+{
+    return matchmaker.size();
 }
 
-void TcpServer::jsonReceived(ServerWorker *sender, const QJsonObject &doc)
+/*
+ * Seuls les messages des clients pas encore loggés arrivent ici, ceux des
+ * clients loggés vont directement à leur partie
+ */
+void TcpServer::messageReceived(ServerWorker *sender, int messageId, const QJsonObject &doc)
 {
     Q_ASSERT(sender);
-    emit logMessage("JSON recu de " + QString::number(sender->getSocketDescriptor()) + " : " + QString::fromUtf8(QJsonDocument(doc).toJson()));
-    if (sender->getUsername().isEmpty()) {
-        // Si le message qu'on reçoit vient d'un utilisateur qui n'a pas de username
-        jsonFromLoggedOut(sender, doc);
+    // Message envoyé juste avant que le client ne soit déplacé dans sa partie
+    if (clientRooms.contains(sender))
         return;
-    }
-    // Si le message vient d'un utilisateur connecté
-    jsonFromLoggedIn(sender, doc);
+    QElapsedTimer handlerTimer;
+    handlerTimer.start();
+    jsonFromLoggedOut(sender, messageId, doc);
+    Metrics::handlerLatency(messageId, handlerTimer.nsecsElapsed());
 }
 
-void TcpServer::userDisconnected(ServerWorker *sender, int threadIdx) {
-    threadsLoaded[threadIdx]--;
+/*
+ * Un client loggé est supprimé par clientLeftRoom, quand sa partie l'a retiré
+ */
+void TcpServer::userDisconnected(ServerWorker *sender) {
+    if (clientRooms.contains(sender))
+        return;
+    matchmaker.remove(sender);
+    threadsLoaded[clientThreads.take(sender)]--;
     clients.removeAll(sender);
-    if(clients.length() == 0) {
-        gameStarted = false;
-        logMessage("Tous les clients sont déconnectés ! Une nouvelle partie peut démarrer...");
-    }
+    sender->deleteLater();
+}
 
-    const QString userName = sender->getUsername();
-    if (!userName.isEmpty()) {
-        QJsonObject userListMessage;
-        userListMessage.insert("type", QJsonValue("updateUsersList"));
-        userListMessage.insert("users", QJsonValue(generateUserList()));
-        sendEveryone(userListMessage);
+void TcpServer::clientLeftRoom(ServerWorker *sender) {
+    threadsLoaded[clientThreads.take(sender)]--;
+    clients.removeAll(sender);
 
-        nbUsersConnected--;
-        emit logMessage(userName + QLatin1String(" disconnected"));
+    Room *room = clientRooms.take(sender);
+    Q_ASSERT(room);
+    room->releaseSeat(sender->getUsername());
+    // Une partie vide n'est plus utile, sa place peut servir à une autre
+    if (room->isEmpty()) {
+        rooms.removeOne(room);
+        roomThreads.remove(room);
+        roomsWaitingSince.remove(room);
+        room->deleteLater();
+        Logger::log(Logger::Info, "Partie " + QString::number(room->getId()) + " fermée, "
+                    + QString::number(rooms.length()) + " partie(s) en cours");
     }
     sender->deleteLater();
 }
@@ -137,7 +299,7 @@ void TcpServer::userDisconnected(ServerWorker *sender, int threadIdx) {
 void TcpServer::userError(ServerWorker *sender)
 {
     Q_UNUSED(sender)
-    emit logMessage(QLatin1String("Erreur de ") + QString::number(sender->getSocketDescriptor()));
+    Logger::log(Logger::Warning, QLatin1String("Erreur de ") + QString::number(sender->getSocketDescriptor()));
 }
 
 void TcpServer::stopServer()
@@ -147,18 +309,13 @@ void TcpServer::stopServer()
 }
 
 /*
- * Tous les messages qu'on reçoit de clients qui n'ont pas de username
+ * Tous les messages qu'on reçoit de clients qui ne sont pas encore dans une partie
  */
-void TcpServer::jsonFromLoggedOut(ServerWorker *sender, const QJsonObject &docObj)
+void TcpServer::jsonFromLoggedOut(ServerWorker *sender, int messageId, const QJsonObject &docObj)
 {
     Q_ASSERT(sender);
-    const QJsonValue typeVal = docObj.value(QLatin1String("type"));
-    if(nbUsersConnected >= 8)
-        return;
-    if (typeVal.isNull() || !typeVal.isString())
-        return;
-    if (typeVal.toString().compare(QLatin1String("login"), Qt::CaseInsensitive) != 0)
-        // Si ce n'est pas un login, on ne fait rien
+    if (messageId != Protocol::Login || matchmaker.contains(sender))
+        // Si ce n'est pas un login, ou s'il attend déjà une partie, on ne fait rien
         return;
     const QJsonValue usernameVal = docObj.value(QLatin1String("username"));
     if (usernameVal.isNull() || !usernameVal.isString())
@@ -166,155 +323,158 @@ void TcpServer::jsonFromLoggedOut(ServerWorker *sender, const QJsonObject &docOb
     const QString newUserName = usernameVal.toString().simplified();
     if (newUserName.isEmpty())
         return;
-    for (ServerWorker *worker : qAsConst(clients)) {
-        if (worker == sender)
-            continue;
-        if (worker->getUsername().compare(newUserName, Qt::CaseInsensitive) == 0) {
-            QJsonObject message;
-            message[QStringLiteral("type")] = QStringLiteral("login");
-            message[QStringLiteral("success")] = false;
-            message[QStringLiteral("reason")] = QStringLiteral("duplicateUsername");
-            sendJson(sender, message);
-            return;
-        }
+
+    Matchmaker::Ticket ticket;
+    ticket.client = sender;
+    ticket.username = newUserName;
+    ticket.roomSize = Matchmaker::parseRoomSize(docObj.value(QLatin1String("roomSize")).toInt());
+    ticket.queuedAtMs = matchmakingClock.elapsed();
+    QJsonObject message;
+    Protocol::MessageId messageId;
+    if (!matchmaker.enqueue(ticket)) {
+        message[QStringLiteral("success")] = false;
+        message[QStringLiteral("reason")] = QStringLiteral("serverFull");
+        messageId = Protocol::Login;
+    } else {
+        // La partie lui confirmera le login quand il y sera placé
+        message[QStringLiteral("queued")] = matchmaker.size();
+        message[QStringLiteral("roomSize")] = ticket.roomSize;
+        messageId = Protocol::QueueStatus;
     }
-    // Envoyer au client qui veut se logger qu'il a réussi
-    sender->setUsername(newUserName);
-    sender->setReady(false);
-    QJsonObject successMessage;
-    successMessage[QStringLiteral("type")] = QStringLiteral("login");
-    successMessage[QStringLiteral("success")] = true;
-    successMessage[QStringLiteral("descriptor")] = sender->getSocketDescriptor();
-    sendJson(sender, successMessage);
-
-    // Envoyer à tout le monde la liste des clients connectés
-    QJsonObject userListMessage;
-    userListMessage.insert("type", QJsonValue("updateUsersList"));
-    userListMessage.insert("users", QJsonValue(generateUserList()));
-    sendEveryone(userListMessage);
-
-    nbUsersConnected++;
+    const QByteArray packet = Room::encode(messageId, message, sender->getSocketDescriptor());
+    QTimer::singleShot(0, sender, std::bind(&ServerWorker::sendPacket, sender, packet, static_cast<int>(messageId), -1));
 }
 
-QJsonObject TcpServer::generateUserList() {
-    QJsonObject clientsHash;
-    for(int i = 0; i < clients.length(); i++) {
-        QJsonObject userProps;
-        userProps.insert("username", clients.at(i)->getUsername());
-        userProps.insert("ready", clients.at(i)->getReady());
-        userProps.insert("gender", clients.at(i)->getGender());
-        userProps.insert("team", clients.at(i)->getTeam());
-        clientsHash.insert(QString::number(clients.at(i)->getSocketDescriptor()), QJsonValue(userProps));
+/*
+ * Place les clients en attente, par groupes :
+ * - d'abord dans les parties en salle d'attente, les plus remplies en
+ *   premier pour qu'elles démarrent au plus vite ;
+ * - puis dans de nouvelles parties, dès qu'il y a assez de clients pour en
+ *   remplir une, ou quand le plus ancien attend depuis trop longtemps.
+ * Enfin, les parties qui attendent depuis trop longtemps sont complétées
+ * avec des bots.
+ */
+void TcpServer::matchmake()
+{
+    const qint64 nowMs = matchmakingClock.elapsed();
+    if (matchmaker.size() > 0) {
+        QList<Room *> waitingRooms;
+        for (Room *room : qAsConst(rooms)) {
+            if (room->isJoinable())
+                waitingRooms.append(room);
+        }
+        std::stable_sort(waitingRooms.begin(), waitingRooms.end(), [](const Room *a, const Room *b) {
+            return a->getNbSeats() > b->getNbSeats();
+        });
+        for (Room *room : qAsConst(waitingRooms)) {
+            const QList<Matchmaker::Ticket> tickets = matchmaker.take(room->getCapacity(), room->getCapacity() - room->getNbSeats(),
+                                                                      std::bind(&Room::hasUsername, room, std::placeholders::_1));
+            for (const Matchmaker::Ticket &ticket : tickets)
+                placeInRoom(ticket, room);
+        }
+
+        bool refused = false;
+        for (int roomSize : Matchmaker::roomSizes()) {
+            while (!refused && rooms.length() < MAX_ROOMS && (matchmaker.size(roomSize) >= roomSize
+                   || (matchmaker.size(roomSize) > 0 && nowMs - matchmaker.oldestQueuedAtMs(roomSize) >= MAX_QUEUE_WAIT_MS))) {
+                Room *room = createRoom(roomSize);
+                if (!room) {
+                    refused = true;
+                    break;
+                }
+                const QList<Matchmaker::Ticket> tickets = matchmaker.take(roomSize, roomSize - room->getNbSeats());
+                for (const Matchmaker::Ticket &ticket : tickets)
+                    placeInRoom(ticket, room);
+            }
+        }
+        if (refused) {
+            nbRefusedRooms++;
+            if (!refusingRooms)
+                Logger::log(Logger::Warning, "Tous les threads ont une partie saturée, nouvelles parties refusées");
+        } else if (refusingRooms)
+            Logger::log(Logger::Info, "Nouvelles parties de nouveau acceptées");
+        refusingRooms = refused;
     }
-    return clientsHash;
-}
 
-void TcpServer::checkEveryoneReady() {
-    for(int i = 0; i < clients.length(); i++) {
-        if(!clients.at(i)->getReady())
-            return;
+    QMutableHashIterator<Room *, qint64> i(roomsWaitingSince);
+    while (i.hasNext()) {
+        i.next();
+        Room *room = i.key();
+        if (room->isStarted()) {
+            i.remove();
+            continue;
+        }
+        if (nowMs - i.value() < BACKFILL_AFTER_MS)
+            continue;
+        // Les bots sont ajoutés dans le thread de la partie, ils y préviennent les clients
+        const int nbBots = room->getCapacity() - room->getNbSeats();
+        QTimer::singleShot(0, room, [room, nbBots]() {
+            for (int j = 0; j < nbBots && room->addBot(); j++) {}
+        });
+        i.remove();
+        nbBackfilledRooms++;
+        Logger::log(Logger::Info, "Partie " + QString::number(room->getId()) + " complétée avec " + QString::number(nbBots) + " bots");
     }
-    startGame();
 }
 
-void TcpServer::startGame() {
-    // Générer la team et le gender de chaque client
-    // On shuffle le vecteur des clients
-    std::random_shuffle(clients.begin(), clients.end());
-    bool teamSetter = 0;
-    for(int i = 0; i < clients.length(); i++) {
-        clients.at(i)->setTeam(teamSetter);
-        teamSetter = !teamSetter;
-        clients.at(i)->setGender(rand()%2);
-    }
-    // Vider la liste des candies libres
-    freeCandies.empty();
-
-    // Envoyer à tout le monde la liste des clients avec les teams / genders
-    // On envoie aussi le descriptor du candy master
-    QJsonObject userListMessage;
-    userListMessage.insert("type", QJsonValue("updateUsersList"));
-    userListMessage.insert("candyMasterDescriptor", QJsonValue(clients.at(0)->getSocketDescriptor()));
-    userListMessage.insert("users", QJsonValue(generateUserList()));
-    sendEveryone(userListMessage);
-
-    QJsonObject startGameMessage;
-    startGameMessage.insert("type", QJsonValue("startGame"));
-    startGameMessage.insert("nbUsers", QJsonValue(clients.length()));
-    sendEveryone(startGameMessage);
-
-    gameStarted = true;
+/*
+ * La partie envoie au client qu'il a réussi et la liste des joueurs à tout le monde
+ */
+void TcpServer::placeInRoom(const Matchmaker::Ticket &ticket, Room *room)
+{
+    ticket.client->setUsername(ticket.username);
+    room->reserveSeat(ticket.username);
+    clientRooms.insert(ticket.client, room);
+    moveToRoom(ticket.client, room);
 }
 
 /*
- * Si le message qu'on reçoit vient d'un utilisateur connecté (on traite le  message)
+ * Nouvelle partie en salle d'attente, dans le thread le moins chargé qui
+ * n'est pas saturé. Retourne nullptr si tous le sont.
  */
-void TcpServer::jsonFromLoggedIn(ServerWorker *sender, const QJsonObject &docObj)
+Room *TcpServer::createRoom(int capacity)
 {
-    Q_ASSERT(sender);
-    const QJsonValue typeVal = docObj.value(QLatin1String("type"));
-    if (typeVal.isNull() || !typeVal.isString()) {
-        return;
-    } else if(typeVal.toString().compare(QLatin1String("toggleReady"), Qt::CaseInsensitive) == 0) {  // Toggle ready
-        sender->setReady(!sender->getReady());
-        QJsonObject userListMessage;
-        userListMessage.insert("type", QJsonValue("updateUsersList"));
-        userListMessage.insert("users", QJsonValue(generateUserList()));
-        sendEveryone(userListMessage);
-        checkEveryoneReady();
-    } else if(typeVal.toString().compare(QLatin1String("playerMove"), Qt::CaseInsensitive) == 0) {   // Déplacement d'un joueur
-        // On le bradcast à tous les autres
-        QJsonObject userListMessage;
-        userListMessage.insert("type", QJsonValue("playerMove"));
-        userListMessage.insert("direction", QJsonValue(docObj.value(QLatin1String("direction"))));
-        userListMessage.insert("playerDescriptor", QJsonValue(docObj.value(QLatin1String("playerDescriptor"))));
-        userListMessage.insert("value", QJsonValue(docObj.value(QLatin1String("value"))));
-        broadcast(userListMessage, sender);
-    } else if(typeVal.toString().compare(QLatin1String("playerRollback"), Qt::CaseInsensitive) == 0) {   // Rollback d'un joueur
-        // On le bradcast à tous les autres
-        QJsonObject userRollback;
-        userRollback.insert("type", QJsonValue("playerRollback"));
-        userRollback.insert("playerX", QJsonValue(docObj.value(QLatin1String("playerX"))));
-        userRollback.insert("playerY", QJsonValue(docObj.value(QLatin1String("playerY"))));
-        userRollback.insert("candies", QJsonValue(docObj.value(QLatin1String("candies"))));
-        userRollback.insert("socketDescriptor", QJsonValue(sender->getSocketDescriptor()));
-        broadcast(userRollback, sender);
-    } else if(typeVal.toString().compare(QLatin1String("newCandy"), Qt::CaseInsensitive) == 0) {   // Spawn d'un candy
-        // On le sauvegarde sur le serveur
-        freeCandies.append(docObj.value(QLatin1String("candyId")).toInt());
-        // On le bradcast à tous les autres
-        QJsonObject newCandy;
-        newCandy.insert("type", QJsonValue("newCandy"));
-        newCandy.insert("candyType", QJsonValue(docObj.value(QLatin1String("candyType"))));
-        newCandy.insert("candySize", QJsonValue(docObj.value(QLatin1String("candySize"))));
-        newCandy.insert("nbPoints", QJsonValue(docObj.value(QLatin1String("nbPoints"))));
-        newCandy.insert("tilePlacementId", QJsonValue(docObj.value(QLatin1String("tilePlacementId"))));
-        newCandy.insert("candyId", QJsonValue(docObj.value(QLatin1String("candyId"))));
-        broadcast(newCandy, sender);
-    } else if(typeVal.toString().compare(QLatin1String("isCandyFree"), Qt::CaseInsensitive) == 0) {   // Est-ce q'un candy est libre
-        // Si l'id du candy qu'un joueur veut récupérer est présent dans la liste des candy libres
-        if(freeCandies.contains(docObj.value(QLatin1String("candyId")).toInt())) {
-            // On le supprimme de la liste
-            freeCandies.removeOne(docObj.value(QLatin1String("candyId")).toInt());
-            // On envoie à tout le monde que tel joueur a récupéré le candy
-            QJsonObject candyTaken;
-            candyTaken.insert("type", QJsonValue("candyTaken"));
-            candyTaken.insert("socketDescriptor", QJsonValue(sender->getSocketDescriptor()));
-            candyTaken.insert("candyId", QJsonValue(docObj.value(QLatin1String("candyId"))));
-            sendEveryone(candyTaken);
-        }
-    } else if(typeVal.toString().compare(QLatin1String("stealCandies"), Qt::CaseInsensitive) == 0) {   // Vol d'un candy
-        // On envoie à tout le monde que tel joueur a volé tel candy
-        QJsonObject candyTaken;
-        candyTaken.insert("type", QJsonValue("stealCandies"));
-        candyTaken.insert("socketDescriptor", QJsonValue(sender->getSocketDescriptor()));
-        candyTaken.insert("candyIdStartingFrom", QJsonValue(docObj.value(QLatin1String("candyIdStartingFrom"))));
-        broadcast(candyTaken, sender);
-    } else if(typeVal.toString().compare(QLatin1String("validateCandies"), Qt::CaseInsensitive) == 0) {   // validation de candies
-        // On envoie à tout le monde que tel joueur a validé tels candies
-        QJsonObject candyTaken;
-        candyTaken.insert("type", QJsonValue("validateCandies"));
-        candyTaken.insert("socketDescriptor", QJsonValue(sender->getSocketDescriptor()));
-        broadcast(candyTaken, sender);
-    }
+    // Une partie reste dans le même thread jusqu'à sa fermeture
+    const int threadIdx = availableThreads.size() < idealThreadCount ? leastLoadedThread() : unsaturatedThread();
+    if (threadIdx == -1)
+        return nullptr;
+    Room *room = new Room(nextRoomId++, capacity, &gameMap, recordWriter);
+    // Encore dans ce thread, la partie n'a personne à prévenir. Il reste
+    // toujours une place pour un humain.
+    for (int i = 0; i < qMin(botsPerRoom, capacity - 1); i++)
+        room->addBot();
+    room->moveToThread(availableThreads.at(threadIdx));
+    connect(availableThreads.at(threadIdx), &QThread::finished, room, &QObject::deleteLater);
+    connect(room, &Room::clientLeft, this, &TcpServer::clientLeftRoom);
+    rooms.append(room);
+    roomThreads.insert(room, threadIdx);
+    roomsWaitingSince.insert(room, matchmakingClock.elapsed());
+    Logger::log(Logger::Info, "Nouvelle partie " + QString::number(room->getId()) + ", "
+                + QString::number(rooms.length()) + " partie(s) en cours");
+    return room;
+}
+
+/*
+ * Déplace le client dans le thread de sa partie. Ensuite, ses messages sont
+ * traités et les réponses envoyées sans changer de thread.
+ */
+void TcpServer::moveToRoom(ServerWorker *client, Room *room)
+{
+    using namespace std::placeholders;
+    const int roomThreadIdx = roomThreads.value(room);
+    threadsLoaded[clientThreads.value(client)]--;
+    threadsLoaded[roomThreadIdx]++;
+    clientThreads.insert(client, roomThreadIdx);
+
+    // Une fois dans le même thread, ces connexions deviennent directes
+    disconnect(client, &ServerWorker::messageReceived, this, nullptr);
+    connect(client, &ServerWorker::messageReceived, room, std::bind(&Room::messageReceived, room, client, _1, _2));
+    connect(client, &ServerWorker::disconnectedFromClient, room, std::bind(&Room::removeClient, room, client));
+
+    // Un objet ne peut être déplacé que depuis son propre thread
+    QThread *roomThread = availableThreads.at(roomThreadIdx);
+    QTimer::singleShot(0, client, [client, room, roomThread]() {
+        client->moveToThread(roomThread);
+        QTimer::singleShot(0, room, std::bind(&Room::addClient, room, client));
+    });
 }
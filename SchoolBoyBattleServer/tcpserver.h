@@ -2,10 +2,14 @@
  * Description : Cette classe s'occupe de tous les clients connectés au serveur.
  *               Lorsqu’un utilisateur se connecte, elle créé un objet ServerWorker,
  *               lui assigne un thread et en garde une référence dans un de ses membres.
- *               Elle permet de centraliser le traitement des données reçues par
- *               les différents clients et offre des fonctions utiles pour envoyer
- *               des messages comme un broadcast, envoyer un paquet à tous les clients
- *               l’envoyeur inclus, etc.
+ *               Au login, le client entre dans la file du Matchmaker avec la
+ *               taille de partie qu'il préfère. Plusieurs fois par seconde,
+ *               les clients en attente sont placés par groupes dans les
+ *               parties (Room) en salle d'attente, ou dans de nouvelles
+ *               parties. Une partie qui attend trop longtemps est complétée
+ *               avec des bots. Chaque partie est liée à un thread et le
+ *               client y est déplacé : ses messages sont ensuite traités par
+ *               sa partie, dans ce thread.
  * Version     : 1.0.0
  * Date        : 25.01.2021
  * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
@@ -14,34 +18,62 @@
 #ifndef TCPSERVER_H
 #define TCPSERVER_H
 
+#include "gamemap.h"
+#include "logger.h"
+#include "matchmaker.h"
+#include "protocol.h"
+#include "recordwriter.h"
+#include "room.h"
 #include "serverworker.h"
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QTcpServer>
 #include <QObject>
 #include <QThread>
+#include <QTimer>
 
 class TcpServer : public QTcpServer
 {
     Q_OBJECT
 public:
-    TcpServer(QObject *parent = nullptr);
+    TcpServer(int threadCount = 0, const QString &recordDir = QString(), int botsPerRoom = 0, QObject *parent = nullptr);
     ~TcpServer();
+    QString renderMetrics() const;
+    int getNbClients() const;
+    int getNbRooms() const;
+    int getNbQueued() const;
+    bool isSaturated() const;
 
 private:
-    bool gameStarted;
     const int idealThreadCount;
+    const int botsPerRoom;
+    GameMap gameMap;                            // Partagé par toutes les parties
     QVector<QThread *> availableThreads;
-    QVector<int> threadsLoaded;
-    int nbUsersConnected;
+    QVector<int> threadsLoaded;                 // Nombre de clients par thread
     QVector<ServerWorker *> clients;
-    QList<int> freeCandies;
+    QHash<ServerWorker *, int> clientThreads;
+    QList<Room *> rooms;
+    QHash<Room *, int> roomThreads;
+    QHash<ServerWorker *, Room *> clientRooms;  // La partie de chaque client loggé
+    int nextRoomId;
+    quint64 nbConnectionsTotal;
+    QTimer *queueStatsTimer;
+    Matchmaker matchmaker;
+    QTimer *matchmakingTimer;
+    QElapsedTimer matchmakingClock;
+    QHash<Room *, qint64> roomsWaitingSince;    // Parties pas encore complétées avec des bots
+    quint64 nbBackfilledRooms;
+    bool refusingRooms;                         // Tous les threads ont une partie saturée
+    quint64 nbRefusedRooms;
+    RecordWriter *recordWriter;                 // nullptr si les parties ne sont pas enregistrées
 
-    void jsonFromLoggedOut(ServerWorker *sender, const QJsonObject &doc);
-    void jsonFromLoggedIn(ServerWorker *sender, const QJsonObject &doc);
-    void sendJson(ServerWorker *destination, const QJsonObject &message);
-    QJsonObject generateUserList();
-    void checkEveryoneReady();
-    void startGame();
+    int leastLoadedThread();
+    int unsaturatedThread() const;
+    void jsonFromLoggedOut(ServerWorker *sender, int messageId, const QJsonObject &doc);
+    Room *createRoom(int capacity);
+    void placeInRoom(const Matchmaker::Ticket &ticket, Room *room);
+    void moveToRoom(ServerWorker *client, Room *room);
 
 protected:
     void incomingConnection(qintptr socketDescription) override;
@@ -51,15 +83,14 @@ public slots:
     void stopServer();
 
 private slots:
-    // On exclut un client car c'est lui qui a envoyé le packet
-    void broadcast(const QJsonObject &msg, ServerWorker *exclude);
-    void jsonReceived(ServerWorker *sender, const QJsonObject &doc);
-    void userDisconnected(ServerWorker *client, int threadIdx);
+    void messageReceived(ServerWorker *sender, int messageId, const QJsonObject &doc);
+    void userDisconnected(ServerWorker *client);
+    void clientLeftRoom(ServerWorker *client);
     void userError(ServerWorker *sender);
-    void sendEveryone(const QJsonObject &message);
+    void logQueueStats();
+    void matchmake();
 
 signals:
-    void logMessage(const QString &msg);
     void stopAllClients();
 };
 
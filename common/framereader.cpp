@@ -0,0 +1,129 @@
+/*
+ * Description : Cette classe découpe les octets reçus d'un socket en paquets
+ *               [taille quint32][contenu], le même format que
+ *               QDataStream << QByteArray. Les octets sont lus dans un seul
+ *               buffer qui ne grandit que pour un paquet plus grand que tous
+ *               les précédents ; les paquets complets sont rendus sans copie,
+ *               directement dans le buffer. Un paquet incomplet ne coûte
+ *               qu'une comparaison jusqu'à ce qu'il soit complet.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "framereader.h"
+#include <QtEndian>
+#include <cstring>
+
+// Un buffer par client connecté : petit au départ, il grandit si besoin
+#define INITIAL_BUFFER_SIZE (4 * 1024)
+#define HEADER_SIZE static_cast<int>(sizeof(quint32))
+// QDataStream écrit cette taille pour un QByteArray nul
+#define NULL_FRAME_SIZE 0xFFFFFFFF
+
+FrameReader::FrameReader(int maxFrameSize) :
+    buffer(INITIAL_BUFFER_SIZE, Qt::Uninitialized),
+    readPos(0),
+    writePos(0),
+    frameSize(-1),
+    maxFrameSize(maxFrameSize),
+    error(false)
+{}
+
+/*
+ * Lit ce que le device a reçu, au plus un paquet de taille maximale. Les
+ * paquets rendus par nextFrame avant cet appel ne sont plus valides.
+ * Retourne false si le flux est en erreur.
+ */
+bool FrameReader::readFrom(QIODevice *device)
+{
+    if(error)
+        return false;
+    const qint64 available = device->bytesAvailable();
+    if(available <= 0)
+        return true;
+    reserve(static_cast<int>(qMin<qint64>(available, maxFrameSize + HEADER_SIZE)));
+    const qint64 nbRead = device->read(buffer.data() + writePos, buffer.size() - writePos);
+    if(nbRead > 0)
+        writePos += static_cast<int>(nbRead);
+    // readyRead n'est pas réémis pour le reste : l'appelant boucle tant
+    // que bytesAvailable() > 0, après avoir vidé les paquets complets
+    return true;
+}
+
+/*
+ * Fait de la place pour size octets après les octets pas encore lus.
+ * Les octets restants (au plus un paquet incomplet) sont ramenés au début
+ * du buffer, qui ne grandit que s'ils ne tiennent pas.
+ */
+void FrameReader::reserve(int size)
+{
+    if(buffer.size() - writePos >= size)
+        return;
+    const int unread = writePos - readPos;
+    if(unread + size > buffer.size()) {
+        int capacity = buffer.size();
+        while(capacity < unread + size)
+            capacity *= 2;
+        QByteArray grown(capacity, Qt::Uninitialized);
+        memcpy(grown.data(), buffer.constData() + readPos, unread);
+        buffer = grown;
+    } else if(unread > 0) {
+        memmove(buffer.data(), buffer.constData() + readPos, unread);
+    }
+    readPos = 0;
+    writePos = unread;
+}
+
+/*
+ * Rend le prochain paquet complet, sans son préfixe de taille. frame
+ * pointe directement dans le buffer : il reste valide jusqu'au prochain
+ * readFrom, il faut le copier pour le garder plus longtemps.
+ */
+bool FrameReader::nextFrame(QByteArray *frame)
+{
+    if(error)
+        return false;
+    if(frameSize < 0) {
+        if(writePos - readPos < HEADER_SIZE)
+            return false;
+        const quint32 size = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(buffer.constData() + readPos));
+        readPos += HEADER_SIZE;
+        if(size == NULL_FRAME_SIZE) {
+            *frame = QByteArray();
+            return true;
+        }
+        if(size > static_cast<quint32>(maxFrameSize)) {
+            error = true;
+            return false;
+        }
+        frameSize = static_cast<int>(size);
+    }
+    if(writePos - readPos < frameSize)
+        return false;
+    *frame = QByteArray::fromRawData(buffer.constData() + readPos, frameSize);
+    readPos += frameSize;
+    frameSize = -1;
+    // Buffer vide : le prochain paquet commence au début, sans déplacement
+    if(readPos == writePos) {
+        readPos = 0;
+        writePos = 0;
+    }
+    return true;
+}
+
+bool FrameReader::hasError() const
+{
+    return error;
+}
+
+/*
+ * Pour un socket réutilisé après une reconnexion
+ */
+void FrameReader::clear()
+{
+    readPos = 0;
+    writePos = 0;
+    frameSize = -1;
+    error = false;
+}
@@ -0,0 +1,40 @@
+/*
+ * Description : Cette classe découpe les octets reçus d'un socket en paquets
+ *               [taille quint32][contenu], le même format que
+ *               QDataStream << QByteArray. Les octets sont lus dans un seul
+ *               buffer qui ne grandit que pour un paquet plus grand que tous
+ *               les précédents ; les paquets complets sont rendus sans copie,
+ *               directement dans le buffer. Un paquet incomplet ne coûte
+ *               qu'une comparaison jusqu'à ce qu'il soit complet.
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef FRAMEREADER_H
+#define FRAMEREADER_H
+
+#include <QByteArray>
+#include <QIODevice>
+
+class FrameReader
+{
+public:
+    explicit FrameReader(int maxFrameSize);
+    bool readFrom(QIODevice *device);
+    bool nextFrame(QByteArray *frame);
+    bool hasError() const;
+    void clear();
+
+private:
+    QByteArray buffer;          // Capacité fixe, seule la partie [readPos, writePos[ est utile
+    int readPos;
+    int writePos;
+    int frameSize;              // Taille du contenu du paquet en cours, -1 tant que sa taille n'est pas lue
+    const int maxFrameSize;
+    bool error;                 // Paquet trop grand : le flux n'est plus lisible
+
+    void reserve(int size);
+};
+
+#endif // FRAMEREADER_H
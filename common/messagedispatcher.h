@@ -0,0 +1,49 @@
+/*
+ * Description : Table de traitement des messages, indexée par l'id du message
+ *               (Protocol::MessageId). Chaque traitement est enregistré une fois
+ *               au démarrage, trouver le bon traitement est ensuite un simple
+ *               accès dans un tableau. Le message arrive déjà décodé.
+ *               Args permet de passer des paramètres en plus au traitement
+ *               (par exemple le client qui a envoyé le message côté serveur).
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef MESSAGEDISPATCHER_H
+#define MESSAGEDISPATCHER_H
+
+#include "protocol.h"
+
+#include <QJsonObject>
+#include <functional>
+
+template<typename... Args>
+class MessageDispatcher
+{
+public:
+    typedef std::function<void(Args..., const QJsonObject &)> Handler;
+
+    void registerHandler(Protocol::MessageId id, Handler handler) {
+        handlers[id] = handler;
+    }
+
+    bool hasHandler(int id) const {
+        return Protocol::isValid(id) && handlers[id];
+    }
+
+    /*
+     * Retourne false si aucun traitement n'est enregistré pour cet id
+     */
+    bool dispatch(int id, Args... args, const QJsonObject &message) const {
+        if(!hasHandler(id))
+            return false;
+        handlers[id](args..., message);
+        return true;
+    }
+
+private:
+    Handler handlers[Protocol::NbMessageIds];
+};
+
+#endif // MESSAGEDISPATCHER_H
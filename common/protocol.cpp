@@ -0,0 +1,161 @@
+/*
+ * Description : Cette classe définit le protocole partagé entre le serveur
+ *               et le client. Chaque message est identifié par un id compact
+ *               (un octet) placé devant le JSON du message, ce qui permet de
+ *               choisir le traitement à faire sans comparer de chaînes.
+ *               Paquet : [taille quint32][id quint8][JSON compact]
+ *               Le serveur regroupe les paquets d'un pas de jeu dans un seul
+ *               paquet batch : [taille quint32][Batch][paquet][paquet]...
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#include "protocol.h"
+#include <QDataStream>
+#include <QJsonDocument>
+#include <QJsonParseError>
+#include <QtEndian>
+
+// Dans le même ordre que Protocol::MessageId, utilisé pour les logs et la configuration
+static const char *messageNames[Protocol::NbMessageIds] = {
+    "playerMove",
+    "snapshot",
+    "claimCandy",
+    "candyTaken",
+    "stealCandies",
+    "validateCandies",
+    "newCandy",
+    "login",
+    "toggleReady",
+    "updateUsersList",
+    "startGame",
+    "userDisconnected",
+    "message",
+    "batch",
+    "snapshotAck",
+    "matchClock",
+    "matchEnd",
+    "queueStatus",
+    "redirect",
+    "shardLoad",
+    "ping",
+    "pong",
+    "lobbyDiff"
+};
+
+/*
+ * Retourne le contenu du paquet (sans le préfixe de taille)
+ */
+QByteArray Protocol::encode(MessageId id, const QJsonObject &message)
+{
+    const QByteArray jsonData = QJsonDocument(message).toJson(QJsonDocument::Compact);
+    QByteArray payload;
+    payload.reserve(1 + jsonData.size());
+    payload.append(static_cast<char>(id));
+    payload.append(jsonData);
+    return payload;
+}
+
+/*
+ * Ajoute le préfixe de taille (même format que QDataStream << QByteArray)
+ */
+QByteArray Protocol::frame(const QByteArray &payload)
+{
+    QByteArray packet;
+    packet.reserve(static_cast<int>(sizeof(quint32)) + payload.size());
+    QDataStream packetStream(&packet, QIODevice::WriteOnly);
+    packetStream.setVersion(QDataStream::Qt_5_9);
+    packetStream << payload;
+    return packet;
+}
+
+/*
+ * Regroupe des paquets déjà préfixés de leur taille dans un seul paquet,
+ * qui ne demande qu'une écriture dans le socket. Un paquet seul est
+ * retourné tel quel.
+ */
+QByteArray Protocol::batch(const QList<QByteArray> &packets)
+{
+    if(packets.size() == 1)
+        return packets.first();
+    int size = 1;
+    for(int i = 0; i < packets.size(); i++)
+        size += packets.at(i).size();
+    QByteArray payload;
+    payload.reserve(size);
+    payload.append(static_cast<char>(Batch));
+    for(int i = 0; i < packets.size(); i++)
+        payload.append(packets.at(i));
+    return frame(payload);
+}
+
+/*
+ * Découpe le contenu d'un paquet batch en contenus de paquets (sans leur
+ * préfixe de taille). Retourne false si ce n'est pas un batch ou s'il est
+ * tronqué ; les paquets complets trouvés avant sont quand même retournés.
+ * Les contenus pointent dans payload, sans copie : ils ne sont valides
+ * que tant que payload l'est.
+ */
+bool Protocol::unbatch(const QByteArray &payload, QList<QByteArray> *payloads)
+{
+    if(payload.isEmpty() || static_cast<quint8>(payload.at(0)) != Batch)
+        return false;
+    int offset = 1;
+    while(offset < payload.size()) {
+        if(payload.size() - offset < static_cast<int>(sizeof(quint32)))
+            return false;
+        const quint32 size = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(payload.constData() + offset));
+        offset += sizeof(quint32);
+        if(size > static_cast<quint32>(payload.size() - offset))
+            return false;
+        payloads->append(QByteArray::fromRawData(payload.constData() + offset, size));
+        offset += size;
+    }
+    return true;
+}
+
+/*
+ * Retourne false si le paquet n'a pas d'id valide ou si le JSON n'est pas un objet
+ */
+bool Protocol::decode(const QByteArray &payload, int *id, QJsonObject *message)
+{
+    if(payload.isEmpty())
+        return false;
+    *id = static_cast<quint8>(payload.at(0));
+    if(!isValid(*id))
+        return false;
+
+    // Un message sans contenu est valide (par exemple toggleReady)
+    if(payload.size() == 1) {
+        *message = QJsonObject();
+        return true;
+    }
+
+    QJsonParseError parseError;
+    // Le JSON est lu en place, sans copier le contenu
+    const QJsonDocument jsonDoc = QJsonDocument::fromJson(QByteArray::fromRawData(payload.constData() + 1, payload.size() - 1), &parseError);
+    if(parseError.error != QJsonParseError::NoError || !jsonDoc.isObject())
+        return false;
+    *message = jsonDoc.object();
+    return true;
+}
+
+QString Protocol::name(int id)
+{
+    if(!isValid(id))
+        return QString::number(id);
+    return QLatin1String(messageNames[id]);
+}
+
+/*
+ * Recherche linéaire : ne sert qu'à lire la configuration, jamais par paquet
+ */
+int Protocol::idFromName(const QString &name)
+{
+    for(int i = 0; i < NbMessageIds; i++) {
+        if(name.compare(QLatin1String(messageNames[i]), Qt::CaseInsensitive) == 0)
+            return i;
+    }
+    return -1;
+}
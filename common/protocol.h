@@ -0,0 +1,78 @@
+/*
+ * Description : Cette classe définit le protocole partagé entre le serveur
+ *               et le client. Chaque message est identifié par un id compact
+ *               (un octet) placé devant le JSON du message, ce qui permet de
+ *               choisir le traitement à faire sans comparer de chaînes.
+ *               Paquet : [taille quint32][id quint8][JSON compact]
+ *               Le serveur regroupe les paquets d'un pas de jeu dans un seul
+ *               paquet batch : [taille quint32][Batch][paquet][paquet]...
+ * Version     : 1.0.0
+ * Date        : 25.01.2021
+ * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
+*/
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+
+// Nombre de snapshots gardés comme base possible, des deux côtés
+#define SNAPSHOT_HISTORY 32
+
+class Protocol
+{
+public:
+    // L'ordre ne compte pas pour la performance, mais ne doit pas changer
+    // entre le client et le serveur
+    enum MessageId : quint8 {
+        PlayerMove = 0,
+        Snapshot,               // Etat des joueurs calculé par le serveur
+        ClaimCandy,             // Contact avec un candy vu par le client, avec le pas qu'il voyait
+        CandyTaken,
+        StealCandies,
+        ValidateCandies,
+        NewCandy,
+        Login,
+        ToggleReady,
+        UpdateUsersList,
+        StartGame,
+        UserDisconnected,
+        ChatMessage,
+        Batch,                  // Plusieurs paquets complets, envoyés en une fois
+        SnapshotAck,            // Dernier snapshot reçu par le client
+        MatchClock,             // Temps restant et scores, décidés par le serveur
+        MatchEnd,               // Scores finaux
+        QueueStatus,            // Le client attend qu'une partie lui soit attribuée
+        Redirect,               // Le routeur envoie le client sur un shard
+        ShardLoad,              // Charge d'un shard, envoyée au routeur par socket locale
+        Ping,                   // Envoyé dans les deux sens, avec l'heure de l'envoyeur
+        Pong,                   // Réponse immédiate au ping, qui renvoie son heure
+        LobbyDiff,              // Changements de la liste des joueurs depuis la version précédente
+        NbMessageIds            // Doit rester le dernier
+    };
+
+    // Champs d'un joueur dans un snapshot, seuls ceux qui ont changé
+    // depuis la base sont envoyés
+    enum SnapshotField : int {
+        FieldX = 1,
+        FieldY = 2,
+        FieldMoves = 4,
+        AllFields = FieldX | FieldY | FieldMoves
+    };
+
+    static QByteArray encode(MessageId id, const QJsonObject &message);
+    static bool decode(const QByteArray &payload, int *id, QJsonObject *message);
+    static QByteArray frame(const QByteArray &payload);
+    static QByteArray batch(const QList<QByteArray> &packets);
+    static bool unbatch(const QByteArray &payload, QList<QByteArray> *payloads);
+    static QString name(int id);
+    static int idFromName(const QString &name);
+    static inline bool isValid(int id) {
+        return id >= 0 && id < NbMessageIds;
+    }
+};
+
+#endif // PROTOCOL_H
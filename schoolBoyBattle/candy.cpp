@@ -42,7 +42,8 @@ Candy::Candy(
       tilePlacement(tilePlacement),
       currentPlayerId(-1),
       taken(false),
-      valid(false)
+      valid(false),
+      generation(0)
 {
     loadAnimations();
     setAnimation(idle);
@@ -159,6 +160,13 @@ void Candy::setCurrentPlayerId(int playerId) {
     currentPlayerId = playerId;
 }
 
+/**
+ * Retourne l'id de l'équipe qui a le bonbon, -1 s'il est libre.
+ */
+int Candy::getTeamId() {
+    return idTeam;
+}
+
 /**
  * Définir l'id de l'équipe que a le bonbon.
  */
@@ -180,6 +188,21 @@ bool Candy::isValidated() {
     return valid;
 }
 
+/**
+ * Retourne la génération du Candy, à renvoyer au serveur pour le ramasser
+ * ou le voler.
+ */
+quint32 Candy::getGeneration() {
+    return generation;
+}
+
+/**
+ * Définir la génération du Candy, reçue du serveur.
+ */
+void Candy::setGeneration(quint32 generation) {
+    this->generation = generation;
+}
+
 /**
  * Retourn l'id du joueur qui est en possession du bonbon.
  */
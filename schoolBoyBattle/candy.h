@@ -41,9 +41,12 @@ public:
     int getNbPoints();
     int getCurrentPlayerId();
     void setCurrentPlayerId(int playerId);
+    int getTeamId();
     void setTeamId(int idTeam);
     void validate();
     bool isValidated();
+    quint32 getGeneration();
+    void setGeneration(quint32 generation);
 
     enum Type : int {peanut = 0, mandarin = 1};
     enum Size : int {small = 0, big = 1};
@@ -68,6 +71,7 @@ private:
     int currentPlayerId;
     bool taken;
     bool valid;
+    quint32 generation;     // Donnée par le serveur à chaque changement de propriétaire
 
     void loadAnimations();
     Candy::AnimationsLocalStruct *setupCandyAnimationData(DataLoader::CandyAnimationsStruct *sharedDatas);
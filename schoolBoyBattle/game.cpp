@@ -29,11 +29,15 @@
 #include "dataloader.h"
 #include "boss.h"
 
-#define SERVER_ROLLBACK_DELAY 1000
+#define SNAPSHOT_SNAP_DISTANCE 100                // Au-delà, le joueur est replacé directement
+#define SNAPSHOT_CORRECTION 0.3                   // Part de l'écart corrigée à chaque snapshot
 #define REFRESH_DELAY 1/60*1000                 // Pour avoir un taux de refresh atteignant 60 images / secondes
+#define LOCAL_MATCH_DURATION_S (3 * 60)         // En multijoueur, la durée est décidée par le serveur
 
 Game::Game(QGraphicsScene *parent)
-    : QGraphicsScene(parent)
+    : QGraphicsScene(parent),
+      localClock(nullptr),
+      localSecondsLeft(0)
 {}
 
 /**
@@ -53,6 +57,7 @@ void Game::startGame(QString terrainFileName, int nbPlayers, bool isMultiplayer,
 
     placeTiles();
     setCustomSceneRect();
+    TileCandyPlacement::resetCandyIds();
     placeTilesCandyPlacement();
     placeBosses();
 
@@ -69,8 +74,6 @@ void Game::startGame(QString terrainFileName, int nbPlayers, bool isMultiplayer,
     connect(playerRefresh, &QTimer::timeout, this, &Game::refreshEntities);
     playerRefresh->start();
     playerRefreshDelta->start();
-    gameTimer = new QTimer(this);
-    gameTimer->singleShot(3 * 60 * 1000, this, &Game::gameEnd);
 }
 
 /**
@@ -100,67 +103,62 @@ void Game::setupLocalGame(int nbPlayers) {
         // Signal qui est émit quand ce joueur valide ses candies
         connect(i.value(), &Player::validateCandies, this, &Game::playerValidateCandies);
     }
+
+    // Pas de serveur : la partie a sa propre horloge
+    localSecondsLeft = LOCAL_MATCH_DURATION_S;
+    localClock = new QTimer(this);
+    localClock->setInterval(1000);
+    connect(localClock, &QTimer::timeout, this, &Game::localClockTick);
+    localClock->start();
+    emit timeLeftChanged(localSecondsLeft);
 }
 
 /**
  * Configuration jeu en multijoueur.
  */
 void Game::setupMultiplayerGame() {
-    // Mettre en place le timer de rollback
-    serverRollback = new QTimer(this);
-    serverRollback->setInterval(SERVER_ROLLBACK_DELAY);
-    connect(serverRollback, &QTimer::timeout, this, &Game::sendRollback);
-    serverRollback->start();
-    connect(this, &Game::rollbackToServer, tcpClient, &TcpClient::rollback);
+    // Recevoir les positions calculées par le serveur
+    connect(tcpClient, &TcpClient::snapshotReceived, this, &Game::receiveSnapshot);
 
-    // Recevoir et traiter les rollbacks
-    connect(tcpClient, &TcpClient::userRollback, this, &Game::receiveRollback);
+    // Recevoir les candies qui apparaissent, le serveur décide quand
+    connect(tcpClient, &TcpClient::spawnNewCandy, this, &Game::spawnCandy);
 
     // Recevoir les joueur qui prennent des candies libres
     connect(tcpClient, &TcpClient::playerPickUpCandy, this, &Game::playerPickedUpCandyMulti);
 
     // Recevoir les candy que tel joueur vol
-    connect(tcpClient, &TcpClient::playerStealCandy, this, &Game::playerStealsCandies);
+    connect(tcpClient, &TcpClient::playerStealCandy, this, &Game::playerStealsCandiesMulti);
 
-    // Recevoir les candy que tel joueur valide
+    // Recevoir les candy que tel joueur valide, nous compris
     connect(tcpClient, &TcpClient::playerValidateCandy, this, &Game::playerValidateCandies);
 
+    // Le temps restant, les scores et la fin de la partie viennent du serveur
+    connect(tcpClient, &TcpClient::matchClock, this, &Game::receiveMatchClock);
+    connect(tcpClient, &TcpClient::matchEnd, this, &Game::receiveMatchEnd);
+
     // Créer chaque joueur présent dans la liste des joueurs de l'objet tcpClient
-    QHash<int, QHash<QString, QString>> clientsList = tcpClient->getUsersList();
+    QHash<int, TcpClient::LobbyUser> clientsList = tcpClient->getUsersList();
     int count = 0;
     int socketDescriptor = tcpClient->getSocketDescriptor();
-    QHashIterator<int, QHash<QString, QString>> i(clientsList);
+    QHashIterator<int, TcpClient::LobbyUser> i(clientsList);
 
     while(i.hasNext()) {
         i.next();
-        QHash<QString, QString> clientProps = i.value();
+        const TcpClient::LobbyUser &clientProps = i.value();
         if(i.key() == socketDescriptor)
             dataLoader->setPlayerIndexInMulti(i.key());
-        players.insert(i.key(), new Player(i.key(), clientProps["team"].toInt(), clientProps["gender"].toInt(), clientProps["username"], dataLoader));
+        players.insert(i.key(), new Player(i.key(), clientProps.team, clientProps.gender, clientProps.username, dataLoader));
         addItem(players.value(i.key()));
 
         // Si le descriptor de l'objet qu'on a ajouté est le même que le nôtre
         if(i.key() == socketDescriptor) {
             players[i.key()]->setMainPlayerInMulti();
 
-            // On connecte la sortie du clavier à ce joueur
+            // On connecte la sortie du clavier à ce joueur, son déplacement
+            // est prédit localement en attendant les snapshots du serveur
             connect(keyboardInputs, &KeyInputs::playerKeyToggle, players.value(i.key()), &Player::keyMove);
-
-            // On connecte la détection des candy au serveur (demander au serveur si un candy est libre)
-            connect(players.value(i.key()), &Player::isCandyFree, tcpClient, &TcpClient::isCandyFree);
-            // Signal qui est émit quand ce joueur (i.value()) vole des candies à d'autres joueurs
-            // Envoyer l'info aux autres joueurs
-            // A FAIRE QUAND ON A LA CONFIRMATION (QUEUEPROTECTED) QUE LES CANDIES PEUVENT ETRE VOLES
-            connect(this, &Game::playerStealCandies, tcpClient, &TcpClient::playerStealsCandies);
-
-            // Voler le candy pour cette instance
-            connect(players.value(i.key()), &Player::stealCandies, this, &Game::playerStealsCandies);
-            // Pour qu'un player puisse demander si tous ses candies sont déjà validés
-            // connect(players.value(i.key()), &Player::arePlayerTakenCandiesValidated, this, &Game::arePlayerTakenCandiesValidated);
-            // Envoyer l'info au serveur que ce joueur a validé ses candies
-            connect(players.value(i.key()), &Player::validateCandies, tcpClient, &TcpClient::playerValidateCandies);
-            // Signal qui est émit quand ce joueur valide ses candies
-            connect(players.value(i.key()), &Player::validateCandies, this, &Game::playerValidateCandies);
+            // Les candies qu'il touche à l'écran sont envoyés au serveur, qui juge
+            connect(players.value(i.key()), &Player::claimCandy, tcpClient, &TcpClient::claimCandy);
         }
         count++;
     }
@@ -175,49 +173,31 @@ void Game::setupMultiplayerGame() {
         j.next();
         connect(tcpClient, &TcpClient::userMove, j.value(), &Player::keyMove);
     }
-
-    // Si notre instance est le candy master
-    if(tcpClient->isCandyMaster()) {
-        for(int i = 0; i < tileCandyPlacements.length(); i++) {
-            // Connecter le signal de création de candy au slot de cette classe
-            connect(tileCandyPlacements.at(i), &TileCandyPlacement::spawnCandy, this, &Game::spawnCandy);
-            // Envoyer les signaux de création des candy au serveur pour les broadcaster ensuite
-            connect(tileCandyPlacements.at(i), &TileCandyPlacement::spawnCandy, tcpClient, &TcpClient::sendNewCandy);
-        }
-    }else{
-        // Connecter les messages du serveur à la création des nouveaux candy
-        connect(tcpClient, &TcpClient::spawnNewCandy, this, &Game::spawnCandy);
-    }
-}
-
-/**
- * Toutes les x millisecondes, envoie au serveur les infos
- * de l'emplacement du joueur et des candy qu'il a ramassé.
- */
-void Game::sendRollback() {
-    Player *player = players.value(dataLoader->getPlayerIndexInMulti());
-    QHash<int, QPointF> candiesTakenToSend;
-    QList<int> candiesTaken = players[dataLoader->getPlayerIndexInMulti()]->getCandiesTaken();
-    for(int i = 0; i < candiesTaken.length(); i++) {
-        candiesTakenToSend.insert(
-                    candiesTaken.at(i),
-                    candies[candiesTaken.at(i)]->pos());
-    }
-    emit rollbackToServer(player->pos(), candiesTakenToSend);
 }
 
 /**
- * Traîte les rollbacks envoyés par les autres joueurs en
- * déplaçant les items là où ils sont indiqués dans le message.
+ * Replace les joueurs là où le serveur les a calculés.
+ * Les autres joueurs sont replacés directement avec leurs touches, car on
+ * ne reçoit pas les touches des joueurs loin de nous. Le nôtre est corrigé
+ * petit à petit pour que sa prédiction ne saute pas à chaque snapshot.
+ * Les candies suivent les joueurs, ils n'ont pas besoin d'être corrigés.
  */
-void Game::receiveRollback(double playerX, double playerY, QHash<int, QPointF> candies, int playerDescriptor) {
-    if(players[playerDescriptor] != nullptr)
-        players.value(playerDescriptor)->setPos(playerX, playerY);
-    QHashIterator<int, QPointF> i(candies);
+void Game::receiveSnapshot(QHash<int, QPointF> playersPos, QHash<int, int> playersMoves) {
+    QHashIterator<int, QPointF> i(playersPos);
     while(i.hasNext()) {
         i.next();
-        if(candies.contains(i.key()) && this->candies[i.key()] != nullptr)
-            this->candies[i.key()]->setPos(i.value());
+        Player *player = players.value(i.key());
+        if(player == nullptr) continue;
+        if(i.key() != dataLoader->getPlayerIndexInMulti()) {
+            player->setPos(i.value());
+            player->setMoves(playersMoves.value(i.key()));
+            continue;
+        }
+        QPointF error = i.value() - player->pos();
+        if(error.manhattanLength() > SNAPSHOT_SNAP_DISTANCE)
+            player->setPos(i.value());
+        else
+            player->setPos(player->pos() + error * SNAPSHOT_CORRECTION);
     }
 }
 
@@ -387,7 +367,7 @@ void Game::refreshEntities() {
 
     while(i.hasNext()) {
         i.next();
-        i.value()->refresh(deltaMs, tcpClient->getSocketDescriptor());
+        i.value()->refresh(deltaMs);
 
         if(!candies.isEmpty()) {
             // Refresh les candies capturés par ce joueur
@@ -445,25 +425,48 @@ void Game::spawnCandy(int candyType, int candySize, int nbPoints, int tilePlacem
  * Le joueur vole des Candy à un adversaire.
  */
 void Game::playerStealsCandies(int candyIdStartingFrom, int playerWinningId) {
-    if(players[playerWinningId] == nullptr || candies[candyIdStartingFrom] == nullptr) return;
-    // Si le candy n'existe plus, on annule
-    if(!candies.contains(candyIdStartingFrom)) return;
-    Player *victim = players[candies[candyIdStartingFrom]->getCurrentPlayerId()];
-    Player *stealer = players[playerWinningId];
+    stealCandies(candyIdStartingFrom, playerWinningId, false);
+}
+
+/**
+ * En multijoueur, le serveur a détecté le vol, on l'applique avec la
+ * nouvelle génération des Candy volés.
+ */
+void Game::playerStealsCandiesMulti(int candyIdStartingFrom, int playerWinningId, quint32 generation) {
+    QList<int> candiesGained = stealCandies(candyIdStartingFrom, playerWinningId, true);
+    for(int i = 0; i < candiesGained.length(); i++)
+        candies[candiesGained.at(i)]->setGeneration(generation);
+}
+
+/**
+ * Est-ce que le joueur peut voler ce Candy.
+ */
+bool Game::canStealCandies(int candyIdStartingFrom, int playerWinningId) {
+    // Si le candy ou un des joueurs n'existe plus, on annule
+    Candy *candy = candies.value(candyIdStartingFrom);
+    if(candy == nullptr) return false;
+    Player *victim = players.value(candy->getCurrentPlayerId());
+    Player *stealer = players.value(playerWinningId);
+    if(victim == nullptr || stealer == nullptr) return false;
 
     // S'ils sont de la même équipe, on annule
-    if(victim->getTeam() == stealer->getTeam()) return;
-    QList<int>candiesGained = victim->looseCandies(candyIdStartingFrom);
+    if(victim->getTeam() == stealer->getTeam()) return false;
 
     // Si le candy est déjà validé dans une équipe, on annule
-    if(candies[candyIdStartingFrom]->isValidated()) return;
+    return !candy->isValidated();
+}
 
-    // S'il n'y a pas de candy volé, on s'arrête là
-    if(candiesGained.length() <= 0) return;
+/**
+ * Déplace les Candy volés dans la queue du voleur, retourne leurs ids.
+ */
+QList<int> Game::stealCandies(int candyIdStartingFrom, int playerWinningId, bool confirmedByServer) {
+    if(!canStealCandies(candyIdStartingFrom, playerWinningId)) return QList<int>();
+    Player *victim = players[candies[candyIdStartingFrom]->getCurrentPlayerId()];
+    Player *stealer = players[playerWinningId];
+    QList<int>candiesGained = victim->looseCandies(candyIdStartingFrom, confirmedByServer);
 
-    // Si on est en multijoueur, confirmer aux autres clients que des candies
-    // ont été volés
-    emit playerStealCandies(candyIdStartingFrom, playerWinningId);
+    // S'il n'y a pas de candy volé, on s'arrête là
+    if(candiesGained.length() <= 0) return candiesGained;
 
     // définir le nouveau joueur pour chacun de ces candy
     for(int i = 0; i < candiesGained.length(); i++) {
@@ -476,6 +479,7 @@ void Game::playerStealsCandies(int candyIdStartingFrom, int playerWinningId) {
 
     // Protéger la queue du joueur
     stealer->protectQueue();
+    return candiesGained;
 }
 
 /**
@@ -489,18 +493,55 @@ void Game::playerValidateCandies(int playerId) {
     for(int i = 0; i < candiesToValidate.length(); i++) {
         if(!candies[candiesToValidate.at(i)]->isValidated()) {
             candies[candiesToValidate.at(i)]->validate();
+            // En multijoueur, les scores arrivent du serveur avec le temps restant
+            if(dataLoader->isMultiplayer())
+                continue;
             scores[players[playerId]->getTeam()] += candies[candiesToValidate.at(i)]->getNbPoints();
             emit teamsPointsChanged(scores[0], scores[1]);
         }
     }
 }
 
+/**
+ * Une seconde de moins en local, la partie se termine à 0.
+ */
+void Game::localClockTick() {
+    localSecondsLeft--;
+    emit timeLeftChanged(localSecondsLeft);
+    if(localSecondsLeft <= 0)
+        gameEnd();
+}
+
+/**
+ * Temps restant et scores envoyés par le serveur, affichés tels quels.
+ */
+void Game::receiveMatchClock(int secondsLeft, int scoreRed, int scoreBlack) {
+    emit timeLeftChanged(secondsLeft);
+    if(scores[0] == scoreRed && scores[1] == scoreBlack)
+        return;
+    scores[0] = scoreRed;
+    scores[1] = scoreBlack;
+    emit teamsPointsChanged(scores[0], scores[1]);
+}
+
+/**
+ * Le serveur a terminé la partie, le gagnant vient de ses scores.
+ */
+void Game::receiveMatchEnd(int scoreRed, int scoreBlack) {
+    scores[0] = scoreRed;
+    scores[1] = scoreBlack;
+    emit teamsPointsChanged(scores[0], scores[1]);
+    emit timeLeftChanged(0);
+    gameEnd();
+}
+
 /**
  * Slot qui n'est utilisé qu'en multijoueur, s'active quand un joueur ramasse
  * un candy qui n'appartenait à personne.
  */
-void Game::playerPickedUpCandyMulti(int descriptor, int candyId) {
+void Game::playerPickedUpCandyMulti(int descriptor, int candyId, quint32 generation) {
     if(candies[candyId] != nullptr && players[descriptor] != nullptr) {
+        candies[candyId]->setGeneration(generation);
         // Dire au candy qu'il a été ramassés par un joueur
         candies[candyId]->pickUp(descriptor, players[descriptor]->getTeam());
         // Ajouter le candy à la liste des candies du joueur
@@ -519,11 +560,17 @@ void Game::deleteCandy(int id, int playerId) {
  * Fin de la partie, fin du timer et affichage du gagnant.
  */
 void Game::gameEnd() {
+    // Plus rien à recevoir du serveur pour cette partie
+    disconnect(tcpClient, nullptr, this, nullptr);
     delete playerRefresh;
     delete playerRefreshDelta;
-    if(dataLoader->isMultiplayer())
-        delete serverRollback;
-    delete gameTimer;
+    playerRefreshDelta = nullptr;
+    // On peut être dans son timeout
+    if(localClock) {
+        localClock->stop();
+        localClock->deleteLater();
+        localClock = nullptr;
+    }
     QHashIterator<int, Player*> i(players);
 
     while(i.hasNext()) {
@@ -49,8 +49,9 @@ private:
     TcpClient *tcpClient;
     QTimer *playerRefresh;
     QElapsedTimer *playerRefreshDelta;
-    QTimer *serverRollback;
-    QTimer *gameTimer;
+    // Horloge de la partie en local seulement, en multijoueur c'est le serveur
+    QTimer *localClock;
+    int localSecondsLeft;
     QHash<int, Player*> players;
     QHash<int, Candy*> candies;
     QList<TileCandyPlacement*> tileCandyPlacements;
@@ -68,25 +69,29 @@ private:
     void placeTilesCandyPlacement();
     void setupMultiplayerGame();
     void setupLocalGame(int nbPlayers);
+    bool canStealCandies(int candyIdStartingFrom, int playerWinningId);
+    QList<int> stealCandies(int candyIdStartingFrom, int playerWinningId, bool confirmedByServer);
     void placeBosses();
 
 private slots:
-    void sendRollback();
-    void receiveRollback(double playerX, double playerY, QHash<int, QPointF> candies, int playerDescriptor);
+    void receiveSnapshot(QHash<int, QPointF> playersPos, QHash<int, int> playersMoves);
     void spawnCandy(int candyType, int candySize, int nbPoints, int tilePlacementId, int candyId);
     void playerStealsCandies(int candyIdStartingFrom, int playerWinningId);
+    void playerStealsCandiesMulti(int candyIdStartingFrom, int playerWinningId, quint32 generation);
     void playerValidateCandies(int playerId);
-    void playerPickedUpCandyMulti(int descriptor, int candyId);
+    void playerPickedUpCandyMulti(int descriptor, int candyId, quint32 generation);
     void deleteCandy(int id, int playerId);
     void gameEnd();
+    void localClockTick();
+    void receiveMatchClock(int secondsLeft, int scoreRed, int scoreBlack);
+    void receiveMatchEnd(int scoreRed, int scoreBlack);
 
 public slots:
     void startGame(QString terrainFileName, int nbPlayers, bool isMultiplayer, TcpClient *tcpClient);
 
 signals:
-    void rollbackToServer(QPointF playerPos, QHash<int, QPointF> candiesTaken);
-    void playerStealCandies(int candyIdStartingFrom, int playerWinningId);
     void teamsPointsChanged(int nbPointsRed, int nbPointsBlack);
+    void timeLeftChanged(int secondsLeft);
     void showEndScreen(int teamWinner);
 
 };
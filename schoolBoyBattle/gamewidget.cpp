@@ -47,9 +47,6 @@ GameWidget::GameWidget(TcpClient *tcpClient, QWidget *parent) :
     timeLeft->setAlignment(Qt::AlignmentFlag::AlignCenter);
     pointsRed->setAlignment(Qt::AlignmentFlag::AlignRight);
     timeLeft->resize(150, timeLeft->size().height() + 20);
-    gameTimer = new QTimer(this);
-    gameTimer->setInterval(1000);
-    gameTimer->stop();
 
     setStyleSheet(""
                   "QLabel {"
@@ -86,8 +83,10 @@ void GameWidget::resizeEvent(QResizeEvent *event) {
  */
 void GameWidget::startGame(int nbPlayers, int nbViews) {
     game = new Game();
+    timeLeft->setText("3:00");
+    timeLeft->setStyleSheet("background-color: #d8d9e6; color: #1b1c1e; font-size: 40px");
 
-    connect(gameTimer, &QTimer::timeout, this, &GameWidget::timerDecreases);
+    connect(game, &Game::timeLeftChanged, this, &GameWidget::updateTimeLeft);
     connect(game, &Game::teamsPointsChanged, this, &GameWidget::updateTeamsPoints);
     connect(game, &Game::showEndScreen, this, [=] (int teamWinner) {
         emit setFinishMenuWinner(teamWinner);
@@ -130,8 +129,6 @@ void GameWidget::startGame(int nbPlayers, int nbViews) {
     ambientMusicPlayer->setMedia(QUrl("qrc:/Resources/sounds/mainTitle.wav"));
     ambientMusicPlayer->play();
     emit stopMenuMusic();
-    min = 3, sec = 0;
-    gameTimer->start();
     gameRunning = true;
 }
 
@@ -144,8 +141,6 @@ void GameWidget::resetGame() {
     delete viewsLayout;
     ambientMusicPlayer->stop();
     gameRunning = false;
-    gameTimer->stop();
-    disconnect(gameTimer, &QTimer::timeout, this, &GameWidget::timerDecreases);
 }
 
 /**
@@ -159,14 +154,12 @@ void GameWidget::updateTeamsPoints(int nbPointsRed, int nbPointsBlack) {
 }
 
 /**
- * Timer de la partie.
+ * Temps restant de la partie, donné par le jeu (le serveur en multijoueur).
  */
-void GameWidget::timerDecreases() {
-    sec--;
-    if(sec < 0) {
-        sec = 59;
-        min--;
-    }
+void GameWidget::updateTimeLeft(int secondsLeft) {
+    secondsLeft = qMax(secondsLeft, 0);
+    const int min = secondsLeft / 60;
+    const int sec = secondsLeft % 60;
 
     if(min == 0 && sec < 16) {
         if(sec % 2 == 0)
@@ -14,7 +14,6 @@
 #include <QLabel>
 #include <QProgressBar>
 #include <QWidget>
-#include <QTimer>
 #include <QMediaPlayer>
 
 #ifndef GAMEWIDGET_H
@@ -40,9 +39,7 @@ private:
     QLabel *pointsRed;
     QLabel *pointsBlack;
     QLabel *timeLeft;
-    int min, sec;
     QMediaPlayer *ambientMusicPlayer;
-    QTimer *gameTimer;
     bool gameRunning;
 
 public slots:
@@ -51,7 +48,7 @@ public slots:
 
 private slots:
     void updateTeamsPoints(int nbPointsRed, int nbPointsBlack);
-    void timerDecreases();
+    void updateTimeLeft(int secondsLeft);
 
 signals:
     void setFinishMenuWinner(int teamWinner);
@@ -110,7 +110,18 @@ void Player::keyMove(int playerId, int direction, bool value) {
     update();
 }
 
-void Player::refresh(double delta, int socketDescriptor) {
+/**
+ * Touches appuyées reçues du serveur, un bit par direction.
+ */
+void Player::setMoves(int movesMask) {
+    for(int direction = moveUp; direction <= moveLeft; direction++) {
+        bool value = movesMask & (1 << direction);
+        if(moves[direction] != value)
+            keyMove(id, direction, value);
+    }
+}
+
+void Player::refresh(double delta) {
     /*
      * déterminer le vecteur mouvement
      * s'il y a une collision
@@ -131,11 +142,15 @@ void Player::refresh(double delta, int socketDescriptor) {
         setZIndex(dataLoader->getPlayerSize().y());
     }
 
-    if((dataLoader->isMultiplayer() && id == socketDescriptor) || !dataLoader->isMultiplayer()) {
+    // En multijoueur, c'est le serveur qui détecte les contacts avec les
+    // bases. Notre joueur lui signale les candies qu'il touche à l'écran.
+    if(!dataLoader->isMultiplayer()) {
         // Detecter si le joueur touche un candy
         collideWithCandy();
         // Detecter si le joueur touche sa base
         collideWithSpawn();
+    } else if(isMainPlayerMulti) {
+        collideWithCandy();
     }
 }
 
@@ -270,23 +285,23 @@ void Player::collideWithCandy() {
 
             if(collidingItem->x() == candyNearby->x() && collidingItem->y() == candyNearby->y()) {
 
-                // si le candy qu'on touche est pris (pas par nous)
-                if(candyNearby->isTaken()) {
-                    if(candyNearby->getCurrentPlayerId() == this->id) continue;
+                // si le candy qu'on touche est déjà à nous, on ne fait rien
+                if(candyNearby->isTaken() && candyNearby->getCurrentPlayerId() == this->id) continue;
+                if(dataLoader->isMultiplayer()) {
+                    // Le serveur refuse le vol à un coéquipier, inutile de le demander
+                    if(candyNearby->isTaken() && candyNearby->getTeamId() == team) continue;
+                    // Le serveur décide si on ramasse ou vole le candy
+                    emit claimCandy(candyNearby->getId(), candyNearby->getGeneration());
+                } else if(candyNearby->isTaken()) {
                     // Voler le candy
                     emit stealCandies(candyNearby->getId(), this->id);
                 } else {
                     // Ramasser le candy
-                    if(dataLoader->isMultiplayer()) {
-                        // Demander au serveur si on peut prendre le candy
-                        emit isCandyFree(candyNearby->getId());
-                    } else {
-                        // appeler une fonction publique de Candy au lieu d'un signal car utiliser
-                        // les signaux / slots demanderait de connecter au préalable tous les joueurs à
-                        // tous les candy
-                        candyNearby->pickUp(id, team);
-                        IdsCandiesTaken.prepend(candyNearby->getId());
-                    }
+                    // appeler une fonction publique de Candy au lieu d'un signal car utiliser
+                    // les signaux / slots demanderait de connecter au préalable tous les joueurs à
+                    // tous les candy
+                    candyNearby->pickUp(id, team);
+                    IdsCandiesTaken.prepend(candyNearby->getId());
                 }
             }
         }
@@ -303,8 +318,10 @@ void Player::prependCandiesTaken(QList<int> candiesGained) {
 
 /**
  * Se faire voler un candy et le perdre.
+ * Un vol confirmé par le serveur ignore la protection de la queue, c'est
+ * le serveur qui l'a vérifiée.
  */
-QList<int> Player::looseCandies(int candyStolenId) {
+QList<int> Player::looseCandies(int candyStolenId, bool confirmedByServer) {
     QList<int> candiesStolen;
 
     // Si le joueur ne contient pas ce candy, on retourne rien
@@ -312,7 +329,7 @@ QList<int> Player::looseCandies(int candyStolenId) {
         return candiesStolen;
 
     // Si la queue du joueur est encore protégée
-    if(queueProtected->isActive())
+    if(!confirmedByServer && queueProtected->isActive())
         return candiesStolen;
 
     for(int i = 0; i < IdsCandiesTaken.length(); i++) {
@@ -33,8 +33,8 @@ public:
     QRectF boundingRect() const override;
     QPainterPath shape() const override;
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
-    void refresh(double delta, int socketDescriptor);
-    QList<int> looseCandies(int candyStolenId);
+    void refresh(double delta);
+    QList<int> looseCandies(int candyStolenId, bool confirmedByServer = false);
     QList<int> getCandiesTaken();
     void pickupCandyMulti(int candyId);
     void prependCandiesTaken(QList<int> candiesGained);
@@ -99,9 +99,10 @@ private:
 
 public slots:
     void keyMove(int playerId, int direction, bool value);
+    void setMoves(int movesMask);
 
 signals:
-    void isCandyFree(int candyId);
+    void claimCandy(int candyId, quint32 generation);
     void stealCandies(int candyIdStartingFrom, int playerWinningId);
     void validateCandies(int id);
     bool arePlayerTakenCandiesValidated(int id);
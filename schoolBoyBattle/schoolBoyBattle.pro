@@ -10,7 +10,12 @@ CONFIG += c++11 resources_big
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Protocole partagé entre le client et le serveur
+INCLUDEPATH += ../common
+
 SOURCES += \
+    ../common/framereader.cpp \
+    ../common/protocol.cpp \
     boss.cpp \
     candy.cpp \
     dataloader.cpp \
@@ -29,6 +34,9 @@ SOURCES += \
     waitingroom.cpp
 
 HEADERS += \
+    ../common/framereader.h \
+    ../common/messagedispatcher.h \
+    ../common/protocol.h \
     boss.h \
     candy.h \
     dataloader.h \
@@ -43,6 +43,7 @@ StartMenu::StartMenu(QWidget *parent) :
     QPushButton *connectToServer = new QPushButton("Se connecter à un serveur");
     serverAddress = new QLineEdit("127.0.0.1", this);
     serverPort = new QLineEdit("1962", this);
+    roomSize = new QComboBox(this);
     QPushButton *btnQuit = new QPushButton("Quitter le jeu");
     QLabel *lblCopyright = new QLabel("HE-ARC Copyright © 2021\nPrétat Valentin, Margueron Yasmine et Badel Kevin", this);
 
@@ -53,6 +54,9 @@ StartMenu::StartMenu(QWidget *parent) :
     serverPort->setMaximumWidth(150);
     serverPort->setPlaceholderText("Port");
     serverPort->setMaximumWidth(50);
+    // Le serveur place les joueurs dans une partie de la taille choisie
+    for(int nbPlayers = 8; nbPlayers >= 2; nbPlayers -= 2)
+        roomSize->addItem(QString::number(nbPlayers) + " joueurs", nbPlayers);
     lblCopyright->setAlignment(Qt::AlignRight);
 
     // Configuration des layout
@@ -71,6 +75,7 @@ StartMenu::StartMenu(QWidget *parent) :
     vLayout->addLayout(startLayout);
     connectToServerLayout->addWidget(serverAddress);
     connectToServerLayout->addWidget(serverPort);
+    connectToServerLayout->addWidget(roomSize);
     connectToServerLayout->addWidget(connectToServer);
     vLayout->addLayout(connectToServerLayout);
     vLayout->addLayout(quitLayout);
@@ -91,7 +96,7 @@ StartMenu::StartMenu(QWidget *parent) :
         if(serverAddress->text() == "" || serverPort->text() == "")
             return;
         emit setVisibleWidget(2);
-        emit startClient(QHostAddress(serverAddress->text()), serverPort->text().toInt());
+        emit startClient(QHostAddress(serverAddress->text()), serverPort->text().toInt(), roomSize->currentData().toInt());
     });
     connect(btnQuit, &QPushButton::clicked, QApplication::instance(), &QApplication::quit);
 }
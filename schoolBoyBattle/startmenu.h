@@ -7,6 +7,7 @@
  * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
 */
 
+#include <QComboBox>
 #include <QDialog>
 #include <QHostAddress>
 #include <QLineEdit>
@@ -24,7 +25,7 @@ public:
 signals:
     void startLocalGame(int nbPlayers, int nbViews);
     void startServer();
-    void startClient(QHostAddress address, int port);
+    void startClient(QHostAddress address, int port, int roomSize);
     void setVisibleWidget(int i);
 
 private:
@@ -32,6 +33,7 @@ private:
 
     QLineEdit *serverAddress;
     QLineEdit *serverPort;
+    QComboBox *roomSize;
 };
 
 #endif // STARTMENU_H
@@ -8,46 +8,116 @@
 
 #include "tcpclient.h"
 #include <QDataStream>
-#include <QJsonParseError>
 #include <QTcpSocket>
 #include <QJsonObject>
 #include <QMessageBox>
 #include <QInputDialog>
 #include <QJsonArray>
+#include <QTimer>
+
+#define PING_INTERVAL_MS 2000
+// Le serveur envoie un ping toutes les 2 secondes : sans rien recevoir
+// pendant ce temps, la connexion est considérée comme perdue
+#define IDLE_TIMEOUT_MS 10000
+#define RTT_SMOOTHING 8
+// Un batch du serveur contient tous les paquets d'un pas, avec de la marge
+#define MAX_FRAME_SIZE (8 * 1024 * 1024)
+// Une demande refusée peut être renvoyée, au plus 2 fois par seconde et par
+// candy : le serveur n'accepte que 20 demandes par seconde
+#define CLAIM_RETRY_MS 500
 
 TcpClient::TcpClient(QObject *parent) :
     QObject(parent),
+    lobbyVersion(0),
+    lobbySynced(false),
     socket(new QTcpSocket(this)),
+    frameReader(MAX_FRAME_SIZE),
+    readingFrames(false),
+    heartbeatTimer(new QTimer(this)),
+    lastReceivedMs(0),
+    rttMs(-1),
     loggedIn(false),
-    candyMaster(false),
-    descriptor(-1)
+    redirecting(false),
+    descriptor(-1),
+    roomSize(8),
+    serverTick(0)
 {
+    for(int i = 0; i < SNAPSHOT_HISTORY; i++)
+        snapshotStates[i].valid = false;
+    clock.start();
+    heartbeatTimer->setInterval(PING_INTERVAL_MS);
+    connect(heartbeatTimer, &QTimer::timeout, this, &TcpClient::heartbeat);
     connect(socket, &QTcpSocket::readyRead, this, &TcpClient::onReadyRead);         // Slot
 //    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred), this, &TcpClient::error); // Slot
-    connect(socket, &QTcpSocket::connected, this, &TcpClient::askUsername);           // Slot
-    connect(socket, &QTcpSocket::connected, this, &TcpClient::connected);           // Signal
-    connect(socket, &QTcpSocket::disconnected, this, &TcpClient::disconnected);     // Signal
+    connect(socket, &QTcpSocket::connected, this, &TcpClient::onConnected);         // Slot
+    connect(socket, &QTcpSocket::disconnected, this, &TcpClient::onDisconnected);   // Slot
     // Creates
 //    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred), this, [=] () {
 //        // Retourner au menu principal
 //        emit connectionError();
 //    });
-    connect(socket, &QTcpSocket::disconnected, this, [=]() {loggedIn = false; });
+    // Les touches doivent partir tout de suite, sans attendre l'algorithme de Nagle
+    connect(socket, &QTcpSocket::connected, this, [=]() {socket->setSocketOption(QAbstractSocket::LowDelayOption, 1); });
+    registerHandlers();
+}
+
+/**
+ * Enregistre le traitement de chaque type de message reçu du serveur.
+ * Le bon traitement est ensuite trouvé directement avec l'id du message.
+ */
+void TcpClient::registerHandlers() {
+    using namespace std::placeholders;
+    dispatcher.registerHandler(Protocol::PlayerMove, std::bind(&TcpClient::onPlayerMove, this, _1));
+    dispatcher.registerHandler(Protocol::Snapshot, std::bind(&TcpClient::onSnapshot, this, _1));
+    dispatcher.registerHandler(Protocol::CandyTaken, std::bind(&TcpClient::onCandyTaken, this, _1));
+    dispatcher.registerHandler(Protocol::StealCandies, std::bind(&TcpClient::onStealCandies, this, _1));
+    dispatcher.registerHandler(Protocol::ValidateCandies, std::bind(&TcpClient::onValidateCandies, this, _1));
+    dispatcher.registerHandler(Protocol::NewCandy, std::bind(&TcpClient::onNewCandy, this, _1));
+    dispatcher.registerHandler(Protocol::Login, std::bind(&TcpClient::onLogin, this, _1));
+    dispatcher.registerHandler(Protocol::UpdateUsersList, std::bind(&TcpClient::onUpdateUsersList, this, _1));
+    dispatcher.registerHandler(Protocol::LobbyDiff, std::bind(&TcpClient::onLobbyDiff, this, _1));
+    dispatcher.registerHandler(Protocol::StartGame, std::bind(&TcpClient::onStartGame, this, _1));
+    dispatcher.registerHandler(Protocol::UserDisconnected, std::bind(&TcpClient::onUserDisconnected, this, _1));
+    dispatcher.registerHandler(Protocol::MatchClock, std::bind(&TcpClient::onMatchClock, this, _1));
+    dispatcher.registerHandler(Protocol::MatchEnd, std::bind(&TcpClient::onMatchEnd, this, _1));
+    dispatcher.registerHandler(Protocol::QueueStatus, std::bind(&TcpClient::onQueueStatus, this, _1));
+    dispatcher.registerHandler(Protocol::Redirect, std::bind(&TcpClient::onRedirect, this, _1));
+    dispatcher.registerHandler(Protocol::Ping, std::bind(&TcpClient::onPing, this, _1));
+    dispatcher.registerHandler(Protocol::Pong, std::bind(&TcpClient::onPong, this, _1));
 }
 
-QHash<int, QHash<QString, QString>> TcpClient::getUsersList() {
+QHash<int, TcpClient::LobbyUser> TcpClient::getUsersList() const {
     return usersList;
 }
 
+void TcpClient::setRoomSize(int roomSize) {
+    this->roomSize = roomSize;
+}
+
+int TcpClient::getRttMs() const {
+    return rttMs;
+}
+
+/**
+ * Envoie un message au serveur : son id suivi du JSON
+ */
+void TcpClient::send(Protocol::MessageId messageId, const QJsonObject &message) {
+    QDataStream clientStream(socket);
+    clientStream.setVersion(QDataStream::Qt_5_9);
+    clientStream << Protocol::encode(messageId, message);
+}
+
+/**
+ * Pendant une redirection, le login part dès qu'on est connecté au shard
+ */
 void TcpClient::login(const QString &username)
 {
-    if (socket->state() == QAbstractSocket::ConnectedState) {
-        QDataStream clientStream(socket);
-        clientStream.setVersion(QDataStream::Qt_5_9);
+    this->username = username;
+    if (socket->state() == QAbstractSocket::ConnectedState && !redirecting) {
         QJsonObject message;
-        message[QStringLiteral("type")] = QStringLiteral("login");
         message[QStringLiteral("username")] = username;
-        clientStream << QJsonDocument(message).toJson(QJsonDocument::Compact);
+        message[QStringLiteral("roomSize")] = roomSize;
+        send(Protocol::Login, message);
     }
 }
 
@@ -55,249 +125,446 @@ void TcpClient::sendMessage(const QString &text)
 {
     if (text.isEmpty())
         return;
-    QDataStream clientStream(socket);
-    clientStream.setVersion(QDataStream::Qt_5_9);
     QJsonObject message;
-    message[QStringLiteral("type")] = QStringLiteral("message");
     message[QStringLiteral("text")] = text;
-    clientStream << QJsonDocument(message).toJson();
+    send(Protocol::ChatMessage, message);
 }
 
 /**
  * Quand le joueur clique sur "prêt" dans la salle d'attente.
  */
 void TcpClient::toggleReady() {
-    QDataStream clientStream(socket);
-    clientStream.setVersion(QDataStream::Qt_5_9);
-    QJsonObject message;
-    message[QStringLiteral("type")] = QStringLiteral("toggleReady");
-    clientStream << QJsonDocument(message).toJson();
+    send(Protocol::ToggleReady, QJsonObject());
 }
 
 /**
  * Quand le joueur appuie ou relache une touche de déplacement
- * du clavier
+ * du clavier. C'est la seule chose que le client envoie pendant le jeu,
+ * le serveur calcule les déplacements et les candies.
  */
 void TcpClient::keyMove(int playerDescriptor, int direction, bool value) {
-    QDataStream clientStream(socket);
-    clientStream.setVersion(QDataStream::Qt_5_9);
     QJsonObject message;
-    message[QStringLiteral("type")] = QStringLiteral("playerMove");
     message[QStringLiteral("playerDescriptor")] = playerDescriptor;
     message[QStringLiteral("direction")] = direction;
     message[QStringLiteral("value")] = value;
-    clientStream << QJsonDocument(message).toJson();
+    send(Protocol::PlayerMove, message);
 }
 
+// TRAITEMENTS DES MESSAGES REÇUS ----------------------------------------------------------
+
 /**
- * Envoi du rollback au serveur
- * Infos à envoyer : la position du joueur et de ses candies
+ * Message de login
  */
-void TcpClient::rollback(QPointF playerPos, QHash<int, QPointF> candiesTaken) {
-    QDataStream clientStream(socket);
-    clientStream.setVersion(QDataStream::Qt_5_9);
+void TcpClient::onLogin(const QJsonObject &docObj) {
+    if (loggedIn)
+        return; // si on est déjà logué, on ignore
+    // le résultat de la valeur contiendra le résultat de notre tentative de connexion
+    const QJsonValue resultVal = docObj.value(QLatin1String("success"));
+    if (resultVal.isNull() || !resultVal.isBool())
+        return; // le message n'a pas de champ de succès, donc on ignore
+    if(docObj.value("reason") == "gameAlreadyStarted") {
+        QMessageBox::critical(nullptr, "Erreur", "La partie a déjà commencé");
+        return;
+    }
+    if(docObj.value("reason") == "serverFull") {
+        QMessageBox::critical(nullptr, "Erreur", "Le serveur est plein, réessayez plus tard");
+        return;
+    }
+    if(docObj.value("reason") == "duplicateUsername") {
+        QMessageBox::critical(nullptr, "Erreur", "Ce nom d'utilisateur est déjà pris");
+        askUsername();
+        return;
+    }
+    const bool loginSuccess = resultVal.toBool();
+    if (loginSuccess) {
+        // connexion avec succès, on le notifie avec le signal de connexion
+        loggedIn = true;
+        descriptor = docObj.value("descriptor").toInt();
+        emit UserLoggedIn();
+        return;
+    }
+    // la tentative de connexion a échoué, on récupère la raison de l'échec en JSON
+    // et le notifier avec le signal loginError
+    const QJsonValue reasonVal = docObj.value(QLatin1String("reason"));
+    emit loginError(reasonVal.toString());
+}
 
-    QJsonObject candies;
-    QHashIterator<int, QPointF> i(candiesTaken);
+/**
+ * Ne lit que les champs présents, pour appliquer aussi les changements
+ */
+void TcpClient::readLobbyUser(const QJsonObject &props, LobbyUser *user) {
+    if (props.contains(QLatin1String("username")))
+        user->username = props.value(QLatin1String("username")).toString();
+    if (props.contains(QLatin1String("ready")))
+        user->ready = props.value(QLatin1String("ready")).toBool();
+    if (props.contains(QLatin1String("gender")))
+        user->gender = props.value(QLatin1String("gender")).toInt();
+    if (props.contains(QLatin1String("team")))
+        user->team = props.value(QLatin1String("team")).toInt();
+    if (props.contains(QLatin1String("bot")))
+        user->bot = props.value(QLatin1String("bot")).toBool();
+}
 
-    while(i.hasNext()) {
-        i.next();
-        QJsonObject candyCoordinates;
-        candyCoordinates.insert("x", i.value().x());
-        candyCoordinates.insert("y", i.value().y());
-        candies.insert(QString::number(i.key()), candyCoordinates);
+/**
+ * Liste complète des joueurs, reçue en arrivant dans la partie
+ */
+void TcpClient::onUpdateUsersList(const QJsonObject &docObj) {
+    usersList.clear();
+    const QJsonObject users = docObj.value(QLatin1String("users")).toObject();
+    for (QJsonObject::const_iterator i = users.constBegin(); i != users.constEnd(); ++i) {
+        LobbyUser user = {QString(), false, 0, 0, false};
+        readLobbyUser(i.value().toObject(), &user);
+        usersList.insert(i.key().toInt(), user);
+    }
+    lobbyVersion = quint32(docObj.value(QLatin1String("version")).toDouble());
+    lobbySynced = true;
+    // La liste est gardée pour créer les joueurs au démarrage du jeu
+    emit userListRefresh(usersList);
+}
+
+/**
+ * Changements de la liste depuis la version précédente. Un changement qui
+ * ne suit pas notre version ne peut pas être appliqué : on redemande la
+ * liste complète et on ignore les changements jusqu'à la recevoir.
+ */
+void TcpClient::onLobbyDiff(const QJsonObject &docObj) {
+    const quint32 version = quint32(docObj.value(QLatin1String("version")).toDouble());
+    if (!lobbySynced)
+        return;
+    if (version != lobbyVersion + 1) {
+        lobbySynced = false;
+        send(Protocol::UpdateUsersList, QJsonObject());
+        return;
     }
+    lobbyVersion = version;
 
-    QJsonObject rollback;
-    //QJsonArray candiesDatas;
-    rollback[QStringLiteral("type")] = QStringLiteral("playerRollback");
-    rollback[QStringLiteral("playerX")] = playerPos.x();
-    rollback[QStringLiteral("playerY")] = playerPos.y();
-    rollback[QStringLiteral("candies")] = candies;
-    clientStream << QJsonDocument(rollback).toJson();
+    const QJsonObject joined = docObj.value(QLatin1String("joined")).toObject();
+    for (QJsonObject::const_iterator i = joined.constBegin(); i != joined.constEnd(); ++i) {
+        LobbyUser user = {QString(), false, 0, 0, false};
+        readLobbyUser(i.value().toObject(), &user);
+        usersList.insert(i.key().toInt(), user);
+    }
+    const QJsonArray left = docObj.value(QLatin1String("left")).toArray();
+    for (int i = 0; i < left.size(); i++)
+        usersList.remove(left.at(i).toString().toInt());
+    const QJsonObject changed = docObj.value(QLatin1String("changed")).toObject();
+    for (QJsonObject::const_iterator i = changed.constBegin(); i != changed.constEnd(); ++i) {
+        QHash<int, LobbyUser>::iterator user = usersList.find(i.key().toInt());
+        if (user != usersList.end())
+            readLobbyUser(i.value().toObject(), &user.value());
+    }
+    emit userListRefresh(usersList);
 }
 
 /**
- * Envoi du nouveau candy créé au serveur.
+ * Un utilisateur a quitté
  */
-void TcpClient::sendNewCandy(int candyType, int candySize, int nbPoints, int tilePlacementId, int candyId) {
-    QDataStream clientStream(socket);
-    clientStream.setVersion(QDataStream::Qt_5_9);
-    QJsonObject message;
-    message[QStringLiteral("type")] = QStringLiteral("newCandy");
-    message[QStringLiteral("candyType")] = candyType;
-    message[QStringLiteral("candySize")] = candySize;
-    message[QStringLiteral("nbPoints")] = nbPoints;
-    message[QStringLiteral("tilePlacementId")] = tilePlacementId;
-    message[QStringLiteral("candyId")] = candyId;
-    clientStream << QJsonDocument(message).toJson();
+void TcpClient::onUserDisconnected(const QJsonObject &docObj) {
+    // on extrait le nom d'utilisateur du nouvel utilisateur
+    const QJsonValue usernameVal = docObj.value(QLatin1String("username"));
+    if (usernameVal.isNull() || !usernameVal.isString())
+        return; // le nom d'utilisateur était invalide donc on ignore
+    // nous informons de la déconnexion de l'utilisateur le signal userLeft
+    emit userLeft(usernameVal.toString());
 }
 
-void TcpClient::isCandyFree(int candyId) {
-    QDataStream clientStream(socket);
-    clientStream.setVersion(QDataStream::Qt_5_9);
-    QJsonObject message;
-    message[QStringLiteral("type")] = QStringLiteral("isCandyFree");
-    message[QStringLiteral("candyId")] = candyId;
-    clientStream << QJsonDocument(message).toJson();
+/**
+ * Démarrage du jeu
+ */
+void TcpClient::onStartGame(const QJsonObject &docObj) {
+    // On peut avoir des parties à min 4 mais jamais en dessous de 2 en serveur
+    if(docObj.value("nbUsers").toInt()  < 2)
+        return;
+    // Les snapshots de la partie précédente ne peuvent plus servir de base
+    for(int i = 0; i < SNAPSHOT_HISTORY; i++)
+        snapshotStates[i].valid = false;
+    serverTick = 0;
+    emit startGame(docObj.value("nbUsers").toInt(), 1);
 }
 
-void TcpClient::playerStealsCandies(int candyIdStartingFrom, int playerWinningId) {
-    Q_UNUSED(playerWinningId)
-    QDataStream clientStream(socket);
-    clientStream.setVersion(QDataStream::Qt_5_9);
-    QJsonObject message;
-    message[QStringLiteral("type")] = QStringLiteral("stealCandies");
-    message[QStringLiteral("candyIdStartingFrom")] = candyIdStartingFrom;
-    clientStream << QJsonDocument(message).toJson();
+/**
+ * Déplacement d'un joueur
+ */
+void TcpClient::onPlayerMove(const QJsonObject &docObj) {
+    emit userMove(
+                docObj["playerDescriptor"].toInt(),
+            docObj["direction"].toInt(),
+            docObj["value"].toBool());
 }
 
-void TcpClient::playerValidateCandies(int playerId) {
-    Q_UNUSED(playerId)
-    QDataStream clientStream(socket);
-    clientStream.setVersion(QDataStream::Qt_5_9);
+/**
+ * Notre joueur touche un candy à l'écran. Le serveur juge le contact au
+ * pas du dernier snapshot reçu, celui qu'on affiche. Le même contact n'est
+ * envoyé qu'une fois par candy, même s'il dure plusieurs images et que
+ * plusieurs candies sont touchés en même temps. Il n'est renvoyé que si le
+ * candy n'a pas changé de main après CLAIM_RETRY_MS.
+ */
+void TcpClient::claimCandy(int candyId, quint32 generation) {
+    const qint64 nowMs = clock.elapsed();
+    QHash<int, ClaimedCandy>::const_iterator claimed = claimedCandies.constFind(candyId);
+    if(claimed != claimedCandies.constEnd() && claimed->generation == generation && nowMs - claimed->sentMs < CLAIM_RETRY_MS)
+        return;
+    ClaimedCandy claim;
+    claim.generation = generation;
+    claim.sentMs = nowMs;
+    claimedCandies.insert(candyId, claim);
     QJsonObject message;
-    message[QStringLiteral("type")] = QStringLiteral("validateCandies");
-    clientStream << QJsonDocument(message).toJson();
-}
-
-void TcpClient::jsonReceived(const QJsonObject &docObj) {
-    // l'action dépend du type de message
-    const QJsonValue typeVal = docObj.value(QLatin1String("type"));
-    if (typeVal.isNull() || !typeVal.isString())
-        return; // le message sans type sera reçu mais on va l'ignorer
-
-    if (typeVal.toString().compare(QLatin1String("login"), Qt::CaseInsensitive) == 0) { // Message de login
-        if (loggedIn)
-            return; // si on est déjà logué, on ignore
-        // le résultat de la valeur contiendra le résultat de notre tentative de connexion
-        const QJsonValue resultVal = docObj.value(QLatin1String("success"));
-        if (resultVal.isNull() || !resultVal.isBool())
-            return; // le message n'a pas de champ de succès, donc on ignore
-        if(docObj.value("reason") == "gameAlreadyStarted") {
-            QMessageBox::critical(nullptr, "Erreur", "La partie a déjà commencé");
-            return;
-        }
-        if(docObj.value("reason") == "duplicateUsername") {
-            QMessageBox::critical(nullptr, "Erreur", "Ce nom d'utilisateur est déjà pris");
-            askUsername();
-            return;
-        }
-        const bool loginSuccess = resultVal.toBool();
-        if (loginSuccess) {
-            // connexion avec succès, on le notifie avec le signal de connexion
-            loggedIn = true;
-            descriptor = docObj.value("descriptor").toInt();
-            emit UserLoggedIn();
-            return;
-        }
-        // la tentative de connexion a échoué, on récupère la raison de l'échec en JSON
-        // et le notifier avec le signal loginError
-        const QJsonValue reasonVal = docObj.value(QLatin1String("reason"));
-        emit loginError(reasonVal.toString());
-    } else if (typeVal.toString().compare(QLatin1String("updateUsersList"), Qt::CaseInsensitive) == 0) { // Refresh la liste des joueurs
-        // Transformer les données json en QHash<int, QHash<QString, QString>>
-        QHash<int, QHash<QString, QString>> usersList;
-        QHash<QString, QVariant> users = docObj.value("users").toObject().toVariantHash();
-        QHashIterator<QString, QVariant> i(users);
-        while(i.hasNext()) {
-            i.next();
-            QHash<QString, QString> clientProps;
-            QHash<QString, QVariant> clientPropsVariant = i.value().toHash();
-            QHashIterator<QString, QVariant> j(clientPropsVariant);
-            while(j.hasNext()) {
-                j.next();
-                clientProps.insert(j.key(), j.value().toString());
-            }
-            usersList.insert(i.key().toInt(), clientProps);
-            // mettre la variable isCandyMaster à true si c'est nous le candy master
-            if(docObj.value(QLatin1String("candyMasterDescriptor")).toInt() == getSocketDescriptor())
-                candyMaster = true;
-        }
-        this->usersList = usersList;        // On sauvegarde la liste des infos de chaque utilisateur dans l'objet pour
-        // reprendre les infos au démarrage du jeu
-        emit userListRefresh(usersList);
-    } else if (typeVal.toString().compare(QLatin1String("userdisconnected"), Qt::CaseInsensitive) == 0) { // Un utilisateur a quitté
-        // on extrait le nom d'utilisateur du nouvel utilisateur
-        const QJsonValue usernameVal = docObj.value(QLatin1String("username"));
-        if (usernameVal.isNull() || !usernameVal.isString())
-            return; // le nom d'utilisateur était invalide donc on ignore
-        // nous informons de la déconnexion de l'utilisateur le signal userLeft
-        emit userLeft(usernameVal.toString());
-    } else if (typeVal.toString().compare(QLatin1String("startGame"), Qt::CaseInsensitive) == 0) {  // Démarrage du jeu
-        // On peut avoir des parties à min 4 mais jamais en dessous de 2 en serveur
-        if(docObj.value("nbUsers").toInt()  < 2)
+    message[QStringLiteral("candyId")] = candyId;
+    message[QStringLiteral("generation")] = qint64(generation);
+    message[QStringLiteral("tick")] = qint64(serverTick);
+    send(Protocol::ClaimCandy, message);
+}
+
+/**
+ * Position et touches appuyées de chaque joueur calculées par le serveur.
+ * Seuls les joueurs proches de nous sont dans chaque snapshot.
+ * Le snapshot ne contient que ce qui a changé depuis "base", un snapshot
+ * qu'on a confirmé : chaque joueur est [masque, champs du masque...].
+ * Seuls les joueurs présents dans le snapshot sont replacés, plus le
+ * nôtre à chaque fois.
+ */
+void TcpClient::onSnapshot(const QJsonObject &docObj) {
+    const quint32 tick = quint32(docObj.value(QLatin1String("tick")).toDouble());
+    QHash<int, PlayerSnapshot> state;
+    if(docObj.contains(QLatin1String("base"))) {
+        const quint32 base = quint32(docObj.value(QLatin1String("base")).toDouble());
+        const SnapshotState &baseState = snapshotStates[base % SNAPSHOT_HISTORY];
+        // Base perdue : on ne confirme rien, le serveur finira par envoyer un snapshot complet
+        if(!baseState.valid || baseState.tick != base)
             return;
-        emit startGame(docObj.value("nbUsers").toInt(), 1);
-    } else if(typeVal.toString().compare(QLatin1String("playerMove"), Qt::CaseInsensitive) == 0) {  // Déplacement d'un joueur
-        emit userMove(
-                    docObj["playerDescriptor"].toInt(),
-                docObj["direction"].toInt(),
-                docObj["value"].toBool());
-    } else if(typeVal.toString().compare(QLatin1String("playerRollback"), Qt::CaseInsensitive) == 0) {  // Rollback d'un joueur
-        QHash<QString, QVariant> candiesVariant = docObj["candies"].toObject().toVariantHash();
-        QHash<int, QPointF> candiesTaken;
-        QHashIterator<QString, QVariant> i(candiesVariant);
-        while(i.hasNext()) {
-            i.next();
-            QJsonObject test = i.value().toJsonObject();
-            candiesTaken.insert(i.key().toInt(),
-                                QPointF(
-                                    test.value("x").toDouble(),
-                                    test.value("y").toDouble()));
-        }
-        emit userRollback(
-                    docObj["playerX"].toDouble(),
-                docObj["playerY"].toDouble(),
-                candiesTaken,
-                docObj["socketDescriptor"].toInt());
-    } else if(typeVal.toString().compare(QLatin1String("newCandy"), Qt::CaseInsensitive) == 0) {  // Nouveau candy a spawné
-        emit spawnNewCandy(
-                    docObj["candyType"].toInt(),
-                docObj["candySize"].toInt(),
-                docObj["nbPoints"].toInt(),
-                docObj["tilePlacementId"].toInt(),
-                docObj["candyId"].toInt());
-    } else if(typeVal.toString().compare(QLatin1String("candyTaken"), Qt::CaseInsensitive) == 0) {  // Un joueur a pris un candy
-        emit playerPickUpCandy(
-                    docObj["socketDescriptor"].toInt(),
-                docObj["candyId"].toInt());
-    } else if(typeVal.toString().compare(QLatin1String("stealCandies"), Qt::CaseInsensitive) == 0) {  // Un joueur a volé un candy
-        emit playerStealCandy(
-                    docObj["candyIdStartingFrom"].toInt(),
+        state = baseState.players;
+    }
+
+    QHash<int, QPointF> playersPos;
+    QHash<int, int> playersMoves;
+    const QJsonObject players = docObj.value(QLatin1String("players")).toObject();
+    for(QJsonObject::const_iterator i = players.constBegin(); i != players.constEnd(); ++i) {
+        const QJsonArray fields = i.value().toArray();
+        const int mask = fields.at(0).toInt();
+        int field = 1;
+        PlayerSnapshot player = state.value(i.key().toInt(), PlayerSnapshot{0, 0, 0});
+        if(mask & Protocol::FieldX) player.x = fields.at(field++).toInt();
+        if(mask & Protocol::FieldY) player.y = fields.at(field++).toInt();
+        if(mask & Protocol::FieldMoves) player.moves = fields.at(field++).toInt();
+        state.insert(i.key().toInt(), player);
+        playersPos.insert(i.key().toInt(), QPointF(player.x, player.y));
+        playersMoves.insert(i.key().toInt(), player.moves);
+    }
+    // Notre joueur est toujours rendu, même absent du delta : sa prédiction
+    // continue d'être corrigée quand il ne bouge plus
+    if(!playersPos.contains(descriptor) && state.contains(descriptor)) {
+        const PlayerSnapshot own = state.value(descriptor);
+        playersPos.insert(descriptor, QPointF(own.x, own.y));
+        playersMoves.insert(descriptor, own.moves);
+    }
+
+    SnapshotState &received = snapshotStates[tick % SNAPSHOT_HISTORY];
+    received.tick = tick;
+    received.valid = true;
+    received.players = state;
+    serverTick = tick;
+
+    QJsonObject ack;
+    ack[QStringLiteral("tick")] = qint64(tick);
+    send(Protocol::SnapshotAck, ack);
+    emit snapshotReceived(playersPos, playersMoves);
+}
+
+/**
+ * Nouveau candy a spawné
+ */
+void TcpClient::onNewCandy(const QJsonObject &docObj) {
+    emit spawnNewCandy(
+                docObj["candyType"].toInt(),
+            docObj["candySize"].toInt(),
+            docObj["nbPoints"].toInt(),
+            docObj["tilePlacementId"].toInt(),
+            docObj["candyId"].toInt());
+}
+
+/**
+ * Un joueur a pris un candy
+ */
+void TcpClient::onCandyTaken(const QJsonObject &docObj) {
+    emit playerPickUpCandy(
+                docObj["socketDescriptor"].toInt(),
+            docObj["candyId"].toInt(),
+            quint32(docObj["generation"].toDouble()));
+}
+
+/**
+ * Un joueur a volé un candy
+ */
+void TcpClient::onStealCandies(const QJsonObject &docObj) {
+    emit playerStealCandy(
+                docObj["candyIdStartingFrom"].toInt(),
+            docObj["socketDescriptor"].toInt(),
+            quint32(docObj["generation"].toDouble()));
+}
+
+/**
+ * Un joueur a validé ses candies
+ */
+void TcpClient::onValidateCandies(const QJsonObject &docObj) {
+    emit playerValidateCandy(
                 docObj["socketDescriptor"].toInt());
-    } else if(typeVal.toString().compare(QLatin1String("validateCandies"), Qt::CaseInsensitive) == 0) {  // Un joueur a volé un candy
-        emit playerValidateCandy(
-                    docObj["socketDescriptor"].toInt());
+}
+
+/**
+ * Temps restant et scores, c'est le serveur qui décide de la fin de la partie
+ */
+void TcpClient::onMatchClock(const QJsonObject &docObj) {
+    const QJsonArray scores = docObj["scores"].toArray();
+    emit matchClock(
+                docObj["remaining"].toInt(),
+            scores.at(0).toInt(),
+            scores.at(1).toInt());
+}
+
+/**
+ * Le login est accepté, le serveur cherche une partie. Le login sera
+ * confirmé par la partie.
+ */
+void TcpClient::onQueueStatus(const QJsonObject &docObj) {
+    emit queued(docObj["queued"].toInt());
+}
+
+/**
+ * Le serveur est un routeur, la partie se joue sur le shard qu'il a
+ * choisi : même adresse, autre port. On change de socket en dehors de
+ * la lecture en cours.
+ */
+void TcpClient::onRedirect(const QJsonObject &docObj) {
+    const quint16 port = quint16(docObj["port"].toInt());
+    if (port == 0 || redirecting)
+        return;
+    redirecting = true;
+    QTimer::singleShot(0, this, [=]() {
+        const QHostAddress address = socket->peerAddress();
+        socket->abort();
+        socket->connectToHost(address, port);
+    });
+}
+
+/**
+ * Le serveur mesure son RTT : on lui renvoie son heure tout de suite
+ */
+void TcpClient::onPing(const QJsonObject &docObj) {
+    send(Protocol::Pong, docObj);
+}
+
+/**
+ * Réponse à notre ping, avec l'heure à laquelle on l'a envoyé
+ */
+void TcpClient::onPong(const QJsonObject &docObj) {
+    const qint64 sentMs = qint64(docObj["t"].toDouble(-1));
+    const qint64 sampleMs = clock.elapsed() - sentMs;
+    if (sentMs < 0 || sampleMs < 0)
+        return;
+    rttMs = rttMs < 0 ? int(sampleMs) : int(rttMs + (sampleMs - rttMs) / RTT_SMOOTHING);
+}
+
+/**
+ * Un serveur qui n'envoie plus rien, pas même ses pings, est injoignable :
+ * on coupe la connexion, le jeu revient au menu comme pour une déconnexion
+ */
+void TcpClient::heartbeat() {
+    if (socket->state() != QAbstractSocket::ConnectedState)
+        return;
+    if (clock.elapsed() - lastReceivedMs > IDLE_TIMEOUT_MS) {
+        heartbeatTimer->stop();
+        socket->abort();
+        return;
     }
+    QJsonObject ping;
+    ping[QStringLiteral("t")] = clock.elapsed();
+    send(Protocol::Ping, ping);
+}
+
+/**
+ * Scores finaux, les mêmes pour tous les clients
+ */
+void TcpClient::onMatchEnd(const QJsonObject &docObj) {
+    const QJsonArray scores = docObj["scores"].toArray();
+    emit matchEnd(
+                scores.at(0).toInt(),
+            scores.at(1).toInt());
 }
 
 void TcpClient::connectToServer(const QHostAddress &address, quint16 port){
+    redirecting = false;
+    username.clear();
     socket->connectToHost(address, port);
 }
 
+/**
+ * Une redirection vers un shard est invisible pour le reste du jeu : le
+ * nom d'utilisateur n'est demandé qu'une fois
+ */
+void TcpClient::onConnected() {
+    lastReceivedMs = clock.elapsed();
+    rttMs = -1;
+    lobbySynced = false;
+    usersList.clear();
+    frameReader.clear();
+    heartbeatTimer->start();
+    if (redirecting) {
+        redirecting = false;
+        if (!username.isEmpty())
+            login(username);
+        return;
+    }
+    emit connected();
+    askUsername();
+}
+
+void TcpClient::onDisconnected() {
+    loggedIn = false;
+    heartbeatTimer->stop();
+    if (!redirecting)
+        emit disconnected();
+}
+
 void TcpClient::disconnectFromHost() {
     socket->disconnectFromHost();
 }
 
+/**
+ * Le serveur regroupe les paquets d'un pas de jeu dans un paquet batch,
+ * qui est découpé ici et traité dans l'ordre en une seule lecture.
+ * Les paquets et les contenus du batch sont lus en place dans le buffer
+ * du FrameReader. Un traitement peut ouvrir une boîte de dialogue, dont
+ * la boucle d'événements rappelle onReadyRead : le buffer ne doit pas
+ * bouger sous les paquets en cours, les nouveaux octets sont donc lus
+ * par la boucle extérieure.
+ */
 void TcpClient::onReadyRead() {
-    QByteArray jsonData;
-    QDataStream socketStream(socket);
-    socketStream.setVersion(QDataStream::Qt_5_7);
-    while(true) {
-        socketStream.startTransaction();
-        socketStream >> jsonData;
-        if (socketStream.commitTransaction()) {
-            QJsonParseError parseError;
-            const QJsonDocument jsonDoc = QJsonDocument::fromJson(jsonData, &parseError);
-            if (parseError.error == QJsonParseError::NoError) {
-                if (jsonDoc.isObject()) // et c'est un JSON object
-                    jsonReceived(jsonDoc.object()); // parser le JSON
+    lastReceivedMs = clock.elapsed();
+    if (readingFrames)
+        return;
+    readingFrames = true;
+    QByteArray payload;
+    QList<QByteArray> payloads;
+    do {
+        frameReader.readFrom(socket);
+        while (frameReader.nextFrame(&payload)) {
+            payloads.clear();
+            Protocol::unbatch(payload, &payloads);
+            if (payloads.isEmpty())
+                payloads.append(payload);
+            for (int i = 0; i < payloads.size(); i++) {
+                int messageId;
+                QJsonObject message;
+                // le message mal formé ou sans traitement sera reçu mais on va l'ignorer
+                if (Protocol::decode(payloads.at(i), &messageId, &message))
+                    dispatcher.dispatch(messageId, message);
             }
-        } else {
-            break;
         }
-    }
+    } while (socket->bytesAvailable() > 0 && !frameReader.hasError());
+    readingFrames = false;
+    // Flux illisible : on ne peut plus retrouver le début des paquets
+    if (frameReader.hasError())
+        socket->abort();
 }
 
 void TcpClient::error(QAbstractSocket::SocketError error) {
@@ -368,7 +635,3 @@ void TcpClient::askUsername() {
 int TcpClient::getSocketDescriptor() {
     return descriptor;
 }
-
-bool TcpClient::isCandyMaster() {
-    return candyMaster;
-}
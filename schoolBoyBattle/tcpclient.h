@@ -6,10 +6,16 @@
  * Auteurs     : Prétat Valentin, Badel Kevin et Margueron Yasmine
 */
 
+#include "framereader.h"
+#include "messagedispatcher.h"
+#include "protocol.h"
+
 #include <QAbstractSocket>
 #include <QObject>
 #include <QPointF>
+#include <QElapsedTimer>
 #include <QTcpSocket>
+#include <QTimer>
 
 #ifndef TCPCLIENT_H
 #define TCPCLIENT_H
@@ -20,18 +26,84 @@ class TcpClient : public QObject
     Q_DISABLE_COPY(TcpClient)
 
 public:
+    // Un joueur de la salle d'attente, indexé par son descriptor
+    typedef struct LobbyUser_s {
+        QString username;
+        bool ready;
+        int gender;
+        int team;
+        bool bot;
+    } LobbyUser;
+
     TcpClient(QObject *parent = nullptr);
     int getSocketDescriptor();
-    bool isCandyMaster();
-    QHash<int, QHash<QString, QString>> getUsersList();
+    QHash<int, LobbyUser> getUsersList() const;
+    void setRoomSize(int roomSize);
+    int getRttMs() const;
 
 private:
-    QHash<int, QHash<QString, QString>> usersList;
+    // Etat d'un joueur reçu dans un snapshot
+    typedef struct PlayerSnapshot_s {
+        int x;
+        int y;
+        int moves;
+    } PlayerSnapshot;
+
+    // Etat de tous les joueurs après le snapshot du pas tick, base possible
+    // pour décoder les snapshots suivants
+    typedef struct SnapshotState_s {
+        quint32 tick;
+        bool valid;
+        QHash<int, PlayerSnapshot> players;
+    } SnapshotState;
+
+    // Dernière demande envoyée pour un candy
+    typedef struct ClaimedCandy_s {
+        quint32 generation;
+        qint64 sentMs;
+    } ClaimedCandy;
+
+    QHash<int, LobbyUser> usersList;
+    quint32 lobbyVersion;       // Version de usersList, chaque changement du serveur la suit
+    bool lobbySynced;           // False en attendant une liste complète
     QTcpSocket *socket;
+    FrameReader frameReader;    // Paquets reçus, lus sans copie
+    bool readingFrames;         // Une boîte de dialogue ouverte pendant la lecture relance onReadyRead
+    QTimer *heartbeatTimer;     // Pings vers le serveur et détection d'un serveur muet
+    QElapsedTimer clock;        // Heure des pings et de la dernière réception
+    qint64 lastReceivedMs;
+    int rttMs;                  // RTT lissé, -1 tant qu'aucun pong n'est revenu
     bool loggedIn;
-    bool candyMaster;
+    bool redirecting;           // Le routeur nous envoie sur un shard
+    QString username;           // Renvoyé au shard si on l'a déjà donné au routeur
     int descriptor;
-    void jsonReceived(const QJsonObject &doc);
+    int roomSize;               // Taille de partie demandée au serveur
+    quint32 serverTick;         // Pas du dernier snapshot reçu
+    QHash<int, ClaimedCandy> claimedCandies;    // Dernière demande pour chaque candy, par id
+    SnapshotState snapshotStates[SNAPSHOT_HISTORY];     // Indexé par tick % SNAPSHOT_HISTORY
+    MessageDispatcher<> dispatcher;
+    void registerHandlers();
+    void send(Protocol::MessageId messageId, const QJsonObject &message);
+
+    // Traitements des messages reçus
+    void onLogin(const QJsonObject &doc);
+    void onUpdateUsersList(const QJsonObject &doc);
+    void onLobbyDiff(const QJsonObject &doc);
+    static void readLobbyUser(const QJsonObject &props, LobbyUser *user);
+    void onUserDisconnected(const QJsonObject &doc);
+    void onStartGame(const QJsonObject &doc);
+    void onPlayerMove(const QJsonObject &doc);
+    void onSnapshot(const QJsonObject &doc);
+    void onNewCandy(const QJsonObject &doc);
+    void onCandyTaken(const QJsonObject &doc);
+    void onStealCandies(const QJsonObject &doc);
+    void onValidateCandies(const QJsonObject &doc);
+    void onMatchClock(const QJsonObject &doc);
+    void onMatchEnd(const QJsonObject &doc);
+    void onQueueStatus(const QJsonObject &doc);
+    void onRedirect(const QJsonObject &doc);
+    void onPing(const QJsonObject &doc);
+    void onPong(const QJsonObject &doc);
 
 public slots:
     void connectToServer(const QHostAddress &address, quint16 port);
@@ -41,19 +113,19 @@ public slots:
     void toggleReady();
     // Signaux du jeu
     void keyMove(int playerId, int direction, bool value);
-    void rollback(QPointF playerPos, QHash<int, QPointF> candiesTaken);
-    void sendNewCandy(int candyType, int candySize, int nbPoints, int tilePlacementId, int candyId);
-    void isCandyFree(int candyId);
-    void playerStealsCandies(int candyIdStartingFrom, int playerWinningId);
-    void playerValidateCandies(int playerId);
+    void claimCandy(int candyId, quint32 generation);
 
 private slots:
     void onReadyRead();
+    void onConnected();
+    void onDisconnected();
+    void heartbeat();
     void error(QAbstractSocket::SocketError error);
     void askUsername();
 
 signals:
     void connected();
+    void queued(int nbQueued);
     void startGame(int nbPlayers, int nbViews);
     void UserLoggedIn();
     void loginError(const QString &reason);
@@ -62,14 +134,16 @@ signals:
     void userLeft();
     void messageReceived(const QString &sender, const QString &text);
     void connectionError();
-    void userListRefresh(QHash<int, QHash<QString, QString>>);
+    void userListRefresh(const QHash<int, TcpClient::LobbyUser> &users);
     void userLeft(const QString &username);
     void userMove(int direction, int playerDescriptor, bool value);
-    void userRollback(double playerX, double playerY, QHash<int, QPointF> candies, int playerDescriptor);
+    void snapshotReceived(QHash<int, QPointF> playersPos, QHash<int, int> playersMoves);
     void spawnNewCandy(int candyType, int candySize, int nbPoints, int tilePlacementId, int candyId);
-    void playerPickUpCandy(int descriptor, int candyId);
-    void playerStealCandy(int candyIdStartingFrom, int winnerDescriptor);
+    void playerPickUpCandy(int descriptor, int candyId, quint32 generation);
+    void playerStealCandy(int candyIdStartingFrom, int winnerDescriptor, quint32 generation);
     void playerValidateCandy(int descriptor);
+    void matchClock(int secondsLeft, int scoreRed, int scoreBlack);
+    void matchEnd(int scoreRed, int scoreBlack);
 };
 
 #endif // TCPCLIENT_H
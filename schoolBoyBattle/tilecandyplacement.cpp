@@ -53,6 +53,13 @@ void TileCandyPlacement::spawnCandyTimer() {
 }
 
 
+/**
+ * Chaque partie recommence à l'id 0, le serveur range les candies par id.
+ */
+void TileCandyPlacement::resetCandyIds() {
+    candyId = 0;
+}
+
 void TileCandyPlacement::candyPickedUp() {
     candySpawned = false;
     int randomDelay = min + (rand() % static_cast<int>(max - min + 1));
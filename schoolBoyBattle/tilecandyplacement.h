@@ -31,6 +31,7 @@ public:
     QRectF boundingRect() const override;
     QPainterPath shape() const override;
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+    static void resetCandyIds();
 
 private:
     bool candySpawned;
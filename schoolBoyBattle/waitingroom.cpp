@@ -90,12 +90,13 @@ WaitingRoom::WaitingRoom(TcpClient *tcpClient, QWidget *parent) :
     connect(btnLeave, &QPushButton::clicked, tcpClient, &TcpClient::disconnectFromHost);
     connect(btnReady, &QPushButton::clicked, tcpClient, &TcpClient::toggleReady);
     connect(tcpClient, &TcpClient::connected, this, &WaitingRoom::connected);
+    connect(tcpClient, &TcpClient::queued, this, &WaitingRoom::queued);
     connect(tcpClient, &TcpClient::startGame, this, [=] () {
         emit setVisibleWidget(0);
     });
 }
 
-void WaitingRoom::userListRefresh(QHash<int, QHash<QString, QString>> users) {
+void WaitingRoom::userListRefresh(const QHash<int, TcpClient::LobbyUser> &users) {
     // Activer / désactiver le bouton "prêt" s'il n'y a pas assez de monde
     if(users.size() >= MIN_USERS) {
         btnReady->setEnabled(true);
@@ -106,23 +107,23 @@ void WaitingRoom::userListRefresh(QHash<int, QHash<QString, QString>> users) {
     }
 
     // Mettre à jour les labels des utilisateurs
-    QHashIterator<int, QHash<QString, QString>> i(users);
+    QHashIterator<int, TcpClient::LobbyUser> i(users);
     int count = 0;
-    while(i.hasNext()) {
+    while(i.hasNext() && count < MAX_USERS) {
         i.next();
-        usersName[count]->setText(i.value().value("username"));
-        usersReady[count]->setText(i.value().value("ready") == "true" ? "Prêt" : "Attente");
+        usersName[count]->setText(i.value().username);
+        usersReady[count]->setText(i.value().ready ? "Prêt" : "Attente");
         if(i.key() == tcpClient->getSocketDescriptor()) {
-            mainLabel->setText("Connecté au serveur en tant que " + i.value().value("username") + " !");
-            if(i.value().value("ready") == "true")
+            mainLabel->setText("Connecté au serveur en tant que " + i.value().username + " !");
+            if(i.value().ready)
                 btnReady->setText("Pas prêt");
         }
         count++;
     }
 
-    for(int i = users.size(); i < MAX_USERS; i++) {
-        usersName[count]->setText("...");
-        usersReady[count]->setText("...");
+    for(int i = count; i < MAX_USERS; i++) {
+        usersName[i]->setText("...");
+        usersReady[i]->setText("...");
     }
 }
 
@@ -132,8 +133,17 @@ void WaitingRoom::connected() {
     btnLeave->setEnabled(true);
 }
 
-void WaitingRoom::startWaitingRoom(QHostAddress address, qint16 port) {
+/**
+ * Le serveur cherche une partie, le bouton "prêt" attend la liste des joueurs.
+ */
+void WaitingRoom::queued(int nbQueued) {
+    mainLabel->setText("Recherche d'une partie (" + QString::number(nbQueued) + " joueur(s) en attente)...");
+    btnReady->setEnabled(false);
+}
+
+void WaitingRoom::startWaitingRoom(QHostAddress address, qint16 port, int roomSize) {
     mainLabel->setText("Chargement...");
+    tcpClient->setRoomSize(roomSize);
     tcpClient->connectToServer(address, port);
     btnReady->setEnabled(false);
     btnLeave->setEnabled(false);
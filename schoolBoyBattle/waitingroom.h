@@ -35,11 +35,12 @@ private:
     QPushButton *btnLeave;
 
 private slots:
-    void userListRefresh(QHash<int, QHash<QString, QString>>);
+    void userListRefresh(const QHash<int, TcpClient::LobbyUser> &users);
     void connected();
+    void queued(int nbQueued);
 
 public slots:
-    void startWaitingRoom(QHostAddress address, qint16 port);
+    void startWaitingRoom(QHostAddress address, qint16 port, int roomSize);
 
 signals:
     void setVisibleWidget(int i);